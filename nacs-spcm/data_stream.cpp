@@ -17,9 +17,1276 @@
  *************************************************************************/
 
 #include "data_stream_p.h"
+#include "dma_buffer.h"
+#include "fft_synth_p.h"
+
+#include <nacs-utils/timer.h>
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <list>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
 
 namespace NaCs {
 namespace Spcm {
 
+namespace {
+
+template<typename P>
+using run_wave_multi_t = void (*)(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                                  const P *const *params);
+
+using run_wave_steps_t = void (*)(int16_t *data, size_t nsteps, const int *nchns,
+                                  channel_param_fixed *const *params,
+                                  const uint32_t *const *phase,
+                                  const uint32_t *const *dphase);
+
+// The batches of constant tones on a single channel with up to this many tones
+// may use the kernels unrolled for the tone count (`run_wave_steps_ntones`).
+// Each generator only instantiates them for the counts where they are faster
+// (`unroll_max_tones`).
+constexpr int max_unroll_tones = 16;
+
+struct GenFuncs {
+    const char *name;
+    // Indexed by the log2 of the number of channels.
+    run_wave_multi_t<channel_param_fixed> run_wave_fixed[3];
+    run_wave_multi_t<channel_param_groups> run_wave_groups[3];
+    run_wave_multi_t<channel_param_ramp2> run_wave_ramp2[3];
+    run_wave_steps_t run_wave_steps[3];
+    int fft_min_tones;
+    // Indexed by the number of tones minus one.
+    // `nullptr` for the counts without an unrolled kernel.
+    run_wave_steps_t run_wave_steps_ntones[max_unroll_tones];
+};
+
+template<typename R, size_t... K>
+static void fill_steps_ntones(run_wave_steps_t *funcs, std::index_sequence<K...>)
+{
+    (void)std::initializer_list<int>{
+        (funcs[K] = R::template run_wave_steps_ntones<int(K) + 1, step_size>, 0)...};
+}
+
+template<typename Gen>
+static bool try_gen(GenFuncs &funcs)
+{
+    if (!Gen::supported())
+        return false;
+    using R = Runner<Gen>;
+    funcs = {Gen::name(),
+             {R::template run_wave_multi<1, step_size, channel_param_fixed>,
+              R::template run_wave_multi<2, step_size, channel_param_fixed>,
+              R::template run_wave_multi<4, step_size, channel_param_fixed>},
+             {R::template run_wave_multi<1, step_size, channel_param_groups>,
+              R::template run_wave_multi<2, step_size, channel_param_groups>,
+              R::template run_wave_multi<4, step_size, channel_param_groups>},
+             {R::template run_wave_multi<1, step_size, channel_param_ramp2>,
+              R::template run_wave_multi<2, step_size, channel_param_ramp2>,
+              R::template run_wave_multi<4, step_size, channel_param_ramp2>},
+             {R::template run_wave_steps<1, step_size>,
+              R::template run_wave_steps<2, step_size>,
+              R::template run_wave_steps<4, step_size>},
+             Gen::fft_min_tones,
+             {}};
+    static_assert(Gen::unroll_max_tones <= max_unroll_tones, "");
+    fill_steps_ntones<R>(funcs.run_wave_steps_ntones,
+                         std::make_index_sequence<Gen::unroll_max_tones>());
+    return true;
+}
+
+template<Precision prec>
+static GenFuncs _select_gen()
+{
+    GenFuncs funcs;
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+    if (try_gen<AVX512GenT<prec>>(funcs) || try_gen<AVX2GenT<prec>>(funcs) ||
+        try_gen<AVXGenT<prec>>(funcs) || try_gen<SSE2GenT<prec>>(funcs)) {
+        return funcs;
+    }
+#elif NACS_CPU_AARCH64
+#  ifdef NACS_SPCM_SVE
+    if (try_gen<SVEGenT<prec>>(funcs))
+        return funcs;
+#  endif
+    if (try_gen<NEONGenT<prec>>(funcs))
+        return funcs;
+#endif
+    try_gen<ScalarGenT<prec>>(funcs);
+    return funcs;
+}
+
+template<Precision prec>
+static GenFuncs select_gen()
+{
+    auto funcs = _select_gen<prec>();
+    // The FFT synthesizer is about as accurate as the default sine function.
+    if (prec == Precision::High)
+        funcs.fft_min_tones = INT_MAX;
+    return funcs;
+}
+
+// The best generator for the host, selected once when the library is loaded
+// so that a binary compiled for the baseline of the architecture can still use
+// all the features available at runtime.
+// Indexed by the `Precision`.
+static const GenFuncs host_gens[] = {select_gen<Precision::Low>(),
+                                     select_gen<Precision::Default>(),
+                                     select_gen<Precision::High>()};
+
+// `sinpif_pi` computes `sin(pi * d) / pi` so the `pi` is folded into the
+// amplitude scaling together with the full scale of the output.
+// This way the generator output can be converted to integer directly.
+constexpr double amp_scale = 32767 * M_PI;
+
+// Don't split the output between workers into slices shorter than this.
+constexpr size_t min_worker_steps = 64;
+
+constexpr size_t fft_steps = FFTSynth::block_size / step_size;
+static_assert(FFTSynth::block_size % step_size == 0, "");
+
+// Maximum number of steps of constant tones generated in one call (`fixed_steps`).
+// The error of the 32bit phase increment accumulates over the batch
+// to at most `2^-33 * 256` cycles, i.e. ~0.006 LSB for a full scale tone.
+constexpr size_t max_batch_steps = 256;
+
+// The longest period (in samples) of the output to be cached,
+// i.e. a base frequency of at least `2^-20` cycles per sample.
+constexpr uint64_t max_cache_period = 1 << 20;
+// The cached output is made at least this long by repeating the period
+// so that it isn't copied in tiny pieces.
+constexpr uint64_t min_cache_len = 4096;
+// The cached period is only replayed until the phase of any of the tones is off
+// by this much (`2^-26` cycles, ~0.003 LSB for a full scale tone) and it is computed
+// again from the exact phase after that.
+constexpr uint64_t max_cache_drift = uint64_t(1) << 38;
+
+// Maximum length of a block in the block cache.
+constexpr uint64_t cache_block_steps = 64;
+
+static NACS_INLINE uint64_t phase_to_fixed(double phase)
+{
+    // Only 53 bits of the fractional part is significant.
+    // Scale it up to 2^53 first to avoid rounding it up to `2^64`.
+    return uint64_t((phase - std::floor(phase)) * 0x1p53) << 11;
+}
+
+static NACS_INLINE int64_t freq_to_fixed(double freq)
+{
+    return int64_t(freq * 0x1p64);
+}
+
+// Phase in unit of pi in `[-1, 1)` as used by the generators.
+static NACS_INLINE float fixed_to_phase(uint64_t phase)
+{
+    return float(int64_t(phase)) * 0x1p-63f;
+}
+
+// Frequency in unit of cycles per step as used by the generators.
+static NACS_INLINE float fixed_to_freq(int64_t freq)
+{
+    static_assert(step_size == 32, "");
+    return float(freq) * 0x1p-59f;
+}
+
+// The quadratic phase term used by the generators in unit of pi per step squared
+// (with the step squared being 512 samples squared).
+static NACS_INLINE float fixed_to_dfreq(int64_t dfreq)
+{
+    static_assert(step_size == 32, "");
+    return float(dfreq) * 0x1p-55f;
+}
+
+// The cubic phase term used by the generators in unit of pi per step cubed
+// for a phase of `ddfreq * i^3 / 6`.
+static NACS_INLINE float fixed_to_ddfreq(int64_t ddfreq)
+{
+    static_assert(step_size == 32, "");
+    return float(ddfreq) * (0x1p-49f / 6);
+}
+
+// The smallest number of samples `q <= max` after which the phase of the frequency `freq`
+// is within `q * 2^-52` cycles of where it started, or 0 if there isn't one.
+// With this tolerance, the candidates are the denominators of the convergents
+// of the continued fraction of the frequency in cycles per sample,
+// which are verified with the exact fixed point arithmetic.
+static uint64_t freq_period(int64_t freq, uint64_t max)
+{
+    auto is_period = [&] (uint64_t q) {
+        auto err = uint64_t(freq) * q;
+        return std::min(err, -err) <= q << 12;
+    };
+    double r = std::abs(double(freq) * 0x1p-64);
+    uint64_t q_prev = 0;
+    uint64_t q = 1;
+    while (!is_period(q)) {
+        if (r == 0)
+            return 0;
+        r = 1 / r;
+        auto a = std::floor(r);
+        r -= a;
+        if (a * double(q) + double(q_prev) > double(max))
+            return 0;
+        auto q_next = uint64_t(a) * q + q_prev;
+        q_prev = q;
+        q = q_next;
+    }
+    return q;
+}
+
+// Mix `v` into the hash `h` with the steps of splitmix64.
+static NACS_INLINE uint64_t hash_combine(uint64_t h, uint64_t v)
+{
+    v += h + 0x9e3779b97f4a7c15;
+    v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9;
+    v = (v ^ (v >> 27)) * 0x94d049bb133111eb;
+    return v ^ (v >> 31);
+}
+
+static NACS_INLINE uint64_t hash_combine(uint64_t h, double v)
+{
+    uint64_t i;
+    memcpy(&i, &v, sizeof(i));
+    return hash_combine(h, i);
+}
+
+// `n * (n - 1) / 2` and `n * (n - 1) * (n - 2) / 6` for an even `n`.
+// Exact modulo `2^64` so that they can be used for the fixed point phase.
+static NACS_INLINE uint64_t binom2(uint64_t n)
+{
+    return (n / 2) * (n - 1);
+}
+
+static NACS_INLINE uint64_t binom3(uint64_t n)
+{
+    uint64_t a = n / 2;
+    uint64_t b = n - 1;
+    uint64_t c = n - 2;
+    if (a % 3 == 0) {
+        a /= 3;
+    }
+    else if (b % 3 == 0) {
+        b /= 3;
+    }
+    else {
+        c /= 3;
+    }
+    return a * b * c;
+}
+
+// The envelope shapes tabulated over their duration.
+// Small enough to stay in the L1 cache and dense enough that the linear interpolation
+// error (< 1e-6) is well below the output resolution.
+struct EnvTables {
+    static constexpr int size = 1024;
+    float data[int(DataStream::Envelope::_Num)][size + 1];
+    EnvTables()
+    {
+        auto erf3 = std::erf(3.0);
+        for (int i = 0; i <= size; i++) {
+            double x = double(i) / size;
+            data[int(DataStream::Envelope::Cosine)][i] = float((1 - std::cos(M_PI * x)) / 2);
+            data[int(DataStream::Envelope::Blackman)][i] =
+                float(0.42 - 0.5 * std::cos(M_PI * x) + 0.08 * std::cos(2 * M_PI * x));
+            data[int(DataStream::Envelope::Erf)][i] =
+                float((std::erf(6 * x - 3) / erf3 + 1) / 2);
+        }
+        // Make sure the envelopes start and end exactly at 0 and 1.
+        for (auto &table: data) {
+            table[0] = 0;
+            table[size] = 1;
+        }
+    }
+    // The value of the envelope at the fraction `x` of the duration.
+    float operator()(int shape, bool fall, double x) const
+    {
+        x = fall ? 1 - x : x;
+        x = std::min(std::max(x, 0.0), 1.0) * size;
+        int idx = std::min(int(x), size - 1);
+        auto frac = float(x - idx);
+        auto table = data[shape];
+        return table[idx] + (table[idx + 1] - table[idx]) * frac;
+    }
+};
+static const EnvTables env_tables;
+
+// Buffer for the output of the generators, which has the same alignment
+// requirement as the buffer passed to `generate`.
+struct OutBuffer {
+    OutBuffer(size_t sz=0)
+        : lines((sz + 31) / 32)
+    {
+    }
+    int16_t *data()
+    {
+        return lines.empty() ? nullptr : lines[0].data;
+    }
+    const int16_t *data() const
+    {
+        return lines.empty() ? nullptr : lines[0].data;
+    }
+    size_t size() const
+    {
+        return lines.size() * 32;
+    }
+    bool empty() const
+    {
+        return lines.empty();
+    }
+
+private:
+    struct alignas(64) Line {
+        int16_t data[32];
+    };
+    std::vector<Line> lines;
+};
+
+}
+
+DataStream::Tones::Tones(uint32_t ntones)
+    : phase(ntones, 0),
+      freq(ntones, 0),
+      dfreq(ntones, 0),
+      ddfreq(ntones, 0),
+      amp(ntones, 0),
+      damp(ntones, 0),
+      ddamp(ntones, 0),
+      env(ntones, Env{0, 0, uint8_t(Envelope::Cosine), false})
+{
+}
+
+double DataStream::Tones::amp_at(uint32_t idx, int i) const
+{
+    auto a = amp[idx] + damp[idx] * i + ddamp[idx] * (i * (i - 1) / 2);
+    auto &e = env[idx];
+    if (!e.len)
+        return a;
+    return a * env_tables(e.shape, e.fall, double(e.t + uint32_t(i)) / e.len);
+}
+
+DataStream::GenState::GenState(uint32_t ntones, uint32_t nchns)
+    : tones(ntones),
+      active(new uint32_t[ntones]),
+      nactive(new int[nchns]),
+      params(new channel_param_fixed[ntones]),
+      ramp_params(new channel_param_packed[ntones]),
+      ramp2_params(new channel_param_ramp2[ntones]),
+      groups(new channel_param_groups[nchns]),
+      step_phase(new uint32_t[ntones]),
+      step_dphase(new uint32_t[ntones])
+{
+}
+
+uint64_t DataStream::Tones::hash() const
+{
+    uint64_t h = 0;
+    for (size_t i = 0; i < phase.size(); i++) {
+        h = hash_combine(h, phase[i]);
+        h = hash_combine(h, uint64_t(freq[i]));
+        h = hash_combine(h, uint64_t(dfreq[i]));
+        h = hash_combine(h, uint64_t(ddfreq[i]));
+        h = hash_combine(h, amp[i]);
+        h = hash_combine(h, damp[i]);
+        h = hash_combine(h, ddamp[i]);
+        auto &e = env[i];
+        h = hash_combine(h, (uint64_t(e.len) << 32) | e.t);
+        h = hash_combine(h, (uint64_t(e.shape) << 1) | e.fall);
+    }
+    return h;
+}
+
+// Inlined so that the multiplications are by constants for the per step update.
+NACS_INLINE void DataStream::GenState::forward(uint64_t n)
+{
+    // Separate pointers so that the compiler knows that the arrays don't alias
+    // and can vectorize the loops.
+    size_t ntones = tones.phase.size();
+    auto *__restrict__ phase = tones.phase.data();
+    auto *__restrict__ freq = tones.freq.data();
+    // Wraps around exactly at the end of each cycle.
+    if (ramp_order == 0) {
+        for (size_t i = 0; i < ntones; i++)
+            phase[i] += uint64_t(freq[i]) * n;
+        return;
+    }
+    auto *__restrict__ dfreq = tones.dfreq.data();
+    auto *__restrict__ amp = tones.amp.data();
+    auto *__restrict__ damp = tones.damp.data();
+    auto n2 = binom2(n);
+    if (ramp_order == 1) {
+        for (size_t i = 0; i < ntones; i++) {
+            auto f = uint64_t(freq[i]);
+            auto df = uint64_t(dfreq[i]);
+            phase[i] += f * n + df * n2;
+            freq[i] = int64_t(f + df * n);
+        }
+        for (size_t i = 0; i < ntones; i++)
+            amp[i] += damp[i] * double(n);
+        return;
+    }
+    auto *__restrict__ ddfreq = tones.ddfreq.data();
+    auto *__restrict__ ddamp = tones.ddamp.data();
+    auto n3 = binom3(n);
+    for (size_t i = 0; i < ntones; i++) {
+        auto f = uint64_t(freq[i]);
+        auto df = uint64_t(dfreq[i]);
+        auto ddf = uint64_t(ddfreq[i]);
+        phase[i] += f * n + df * n2 + ddf * n3;
+        freq[i] = int64_t(f + df * n + ddf * n2);
+        dfreq[i] = int64_t(df + ddf * n);
+    }
+    for (size_t i = 0; i < ntones; i++) {
+        amp[i] += damp[i] * double(n) + ddamp[i] * double(n2);
+        damp[i] += ddamp[i] * double(n);
+    }
+    if (!has_env)
+        return;
+    for (size_t i = 0; i < ntones; i++) {
+        auto &e = tones.env[i];
+        if (!e.len)
+            continue;
+        if (n < e.len - e.t) {
+            e.t += uint32_t(n);
+            continue;
+        }
+        if (e.fall) {
+            amp[i] = 0;
+            damp[i] = 0;
+            ddamp[i] = 0;
+        }
+        e.len = 0;
+        changed = true;
+        version++;
+    }
+}
+
+struct DataStream::FFTState {
+    // One for each channel so that the cached tone parameters stay valid.
+    FFTSynth synth[4];
+    std::vector<FFTSynth::Tone> tones;
+    float out[FFTSynth::block_size];
+};
+
+struct DataStream::PeriodCache {
+    // The `version` of the tones it is computed for.
+    uint64_t version = UINT64_MAX;
+    // 0 if the output is not periodic.
+    uint64_t period = 0;
+    // Number of samples after `t0` that can be copied from `data`
+    // before the phase error reaches `max_cache_drift`.
+    uint64_t max_len = 0;
+    // Time of the first sample in `data`.
+    uint64_t t0 = 0;
+    // The output for one period (the first `period` samples), empty if not computed yet.
+    OutBuffer data;
+};
+
+// Shared by all the workers.
+struct DataStream::BlockCache {
+    using Data = std::shared_ptr<const OutBuffer>;
+    BlockCache(size_t max_bytes)
+        : max_bytes(max_bytes)
+    {
+    }
+    // Returns a null pointer if the block is not in the cache.
+    Data get(uint64_t key);
+    void put(uint64_t key, Data data);
+
+    const size_t max_bytes;
+    mutable std::mutex lock;
+    // The most recently used block is at the front.
+    std::list<std::pair<uint64_t,Data>> blocks;
+    std::unordered_map<uint64_t,decltype(blocks)::iterator> index;
+    size_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+DataStream::BlockCache::Data DataStream::BlockCache::get(uint64_t key)
+{
+    std::lock_guard<std::mutex> locker(lock);
+    auto it = index.find(key);
+    if (it == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    blocks.splice(blocks.begin(), blocks, it->second);
+    return it->second->second;
+}
+
+void DataStream::BlockCache::put(uint64_t key, Data data)
+{
+    auto sz = data->size() * sizeof(int16_t);
+    if (sz > max_bytes)
+        return;
+    std::lock_guard<std::mutex> locker(lock);
+    // Another worker may have computed the same block.
+    if (index.count(key))
+        return;
+    while (bytes + sz > max_bytes) {
+        auto &last = blocks.back();
+        bytes -= last.second->size() * sizeof(int16_t);
+        index.erase(last.first);
+        blocks.pop_back();
+    }
+    blocks.emplace_front(key, std::move(data));
+    index[key] = blocks.begin();
+    bytes += sz;
+}
+
+struct DataStream::Worker {
+    Worker(const DataStream &stream, int cpu);
+    ~Worker();
+    void start(int16_t *out, size_t nsteps);
+    void wait();
+
+    const DataStream &stream;
+    GenState state;
+    std::atomic<uint64_t> nsteps_done{0};
+    std::atomic<uint64_t> time{0};
+
+private:
+    void run();
+
+    std::mutex lock;
+    std::condition_variable cond;
+    int16_t *out = nullptr;
+    size_t nsteps = 0;
+    bool busy = false;
+    bool quit = false;
+    std::thread thread;
+};
+
+DataStream::Worker::Worker(const DataStream &stream, int cpu)
+    : stream(stream),
+      state(stream.m_ntones * stream.m_nchns, stream.m_nchns),
+      thread(&Worker::run, this)
+{
+    if (cpu < 0)
+        return;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (auto err = pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset)) {
+        {
+            std::lock_guard<std::mutex> locker(lock);
+            quit = true;
+        }
+        cond.notify_all();
+        thread.join();
+        throw std::system_error(err, std::system_category(),
+                                "DataStream: failed to pin worker thread");
+    }
+}
+
+DataStream::Worker::~Worker()
+{
+    {
+        std::lock_guard<std::mutex> locker(lock);
+        quit = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+void DataStream::Worker::start(int16_t *_out, size_t _nsteps)
+{
+    {
+        std::lock_guard<std::mutex> locker(lock);
+        out = _out;
+        nsteps = _nsteps;
+        busy = true;
+    }
+    cond.notify_all();
+}
+
+void DataStream::Worker::wait()
+{
+    std::unique_lock<std::mutex> locker(lock);
+    cond.wait(locker, [&] { return !busy; });
+}
+
+void DataStream::Worker::run()
+{
+    std::unique_lock<std::mutex> locker(lock);
+    while (true) {
+        cond.wait(locker, [&] { return busy || quit; });
+        if (quit)
+            return;
+        locker.unlock();
+        auto t0 = getTime();
+        stream.gen_steps(state, out, nsteps);
+        time.fetch_add(getElapse(t0), std::memory_order_relaxed);
+        nsteps_done.fetch_add(nsteps, std::memory_order_relaxed);
+        locker.lock();
+        busy = false;
+        cond.notify_all();
+    }
+}
+
+NACS_EXPORT() DataStream::DataStream(uint32_t ntones, uint32_t nchns)
+    : m_ntones(ntones),
+      m_nchns(nchns),
+      m_state(ntones * nchns, nchns)
+{
+    if (ntones == 0) {
+        throw std::invalid_argument("DataStream: no tones");
+    }
+    if (nchns != 1 && nchns != 2 && nchns != 4) {
+        throw std::invalid_argument("DataStream: invalid number of channels");
+    }
+}
+
+NACS_EXPORT() DataStream::~DataStream()
+{
+}
+
+NACS_EXPORT() const char *DataStream::gen_name()
+{
+    return host_gens[int(Precision::Default)].name;
+}
+
+NACS_EXPORT() void DataStream::set_block_cache(size_t max_bytes)
+{
+    if (!max_bytes) {
+        m_block_cache.reset();
+        return;
+    }
+    m_block_cache.reset(new BlockCache(max_bytes));
+    // The hash is only computed for the commands applied with the cache enabled.
+    m_state.seg_t = m_state.t;
+    m_state.seg_hash = m_state.tones.hash();
+}
+
+NACS_EXPORT() DataStream::BlockCacheStats DataStream::block_cache_stats() const
+{
+    if (!m_block_cache)
+        return {0, 0, 0, 0};
+    auto &cache = *m_block_cache;
+    std::lock_guard<std::mutex> locker(cache.lock);
+    return {cache.hits, cache.misses, cache.blocks.size(), cache.bytes};
+}
+
+NACS_EXPORT() void DataStream::set_precision(Precision prec)
+{
+    if (prec != Precision::Low && prec != Precision::Default && prec != Precision::High)
+        throw std::invalid_argument("DataStream: invalid precision");
+    m_prec = prec;
+    // Drop the cached periodic output.
+    m_state.version++;
+}
+
+NACS_EXPORT() void DataStream::set_workers(const std::vector<int> &cpus)
+{
+    m_workers.clear();
+    for (auto cpu: cpus) {
+        m_workers.emplace_back(new Worker(*this, cpu));
+    }
+}
+
+NACS_EXPORT() std::vector<DataStream::WorkerStats> DataStream::worker_stats() const
+{
+    std::vector<WorkerStats> res;
+    for (auto &worker: m_workers)
+        res.push_back({worker->nsteps_done.load(std::memory_order_relaxed),
+                       worker->time.load(std::memory_order_relaxed)});
+    return res;
+}
+
+void DataStream::check_cmd(const Cmd &cmd)
+{
+    if (cmd.chn >= m_state.tones.phase.size())
+        throw std::invalid_argument("DataStream: tone index out of bound");
+    if (cmd.t < m_last_t)
+        throw std::invalid_argument("DataStream: command out of order");
+    if ((cmd.op == CmdType::Freq || cmd.op == CmdType::FreqRamp ||
+         cmd.op == CmdType::FreqRamp2) && !(std::abs(cmd.val) < 0.5))
+        throw std::invalid_argument("DataStream: frequency out of range");
+    if (cmd.op == CmdType::EnvShape &&
+        !(cmd.val >= 0 && cmd.val < int(Envelope::_Num) && cmd.val == std::floor(cmd.val)))
+        throw std::invalid_argument("DataStream: invalid envelope shape");
+    if ((cmd.op == CmdType::EnvRise || cmd.op == CmdType::EnvFall) &&
+        !(cmd.val > 0 && cmd.val < 0x1p31))
+        throw std::invalid_argument("DataStream: envelope duration out of range");
+    m_last_t = cmd.t;
+}
+NACS_EXPORT() void DataStream::add_cmd(const Cmd &cmd)
+{
+    std::lock_guard<std::mutex> locker(m_cmd_lock);
+    check_cmd(cmd);
+    m_new_cmds.push_back(cmd);
+}
+
+NACS_EXPORT() void DataStream::add_cmds(const Cmd *cmds, size_t ncmds)
+{
+    std::lock_guard<std::mutex> locker(m_cmd_lock);
+    for (size_t i = 0; i < ncmds; i++) {
+        check_cmd(cmds[i]);
+        m_new_cmds.push_back(cmds[i]);
+    }
+}
+
+void DataStream::fetch_cmds()
+{
+    if (m_state.cmd_idx) {
+        m_cmds.erase(m_cmds.begin(), m_cmds.begin() + m_state.cmd_idx);
+        m_state.cmd_idx = 0;
+    }
+    std::lock_guard<std::mutex> locker(m_cmd_lock);
+    if (m_cmds.empty()) {
+        // Reuse the memory of both buffers.
+        std::swap(m_cmds, m_new_cmds);
+    }
+    else {
+        m_cmds.insert(m_cmds.end(), m_new_cmds.begin(), m_new_cmds.end());
+        m_new_cmds.clear();
+    }
+}
+
+void DataStream::apply_cmds(GenState &state) const
+{
+    auto &tones = state.tones;
+    auto cmd_idx0 = state.cmd_idx;
+    for (; state.cmd_idx < m_cmds.size(); state.cmd_idx++) {
+        auto &cmd = m_cmds[state.cmd_idx];
+        if (cmd.t > state.t)
+            break;
+        auto idx = cmd.chn;
+        state.changed = true;
+        state.version++;
+        switch (cmd.op) {
+        case CmdType::Phase:
+            tones.phase[idx] = phase_to_fixed(cmd.val);
+            break;
+        case CmdType::Freq:
+            tones.freq[idx] = freq_to_fixed(cmd.val);
+            tones.dfreq[idx] = 0;
+            tones.ddfreq[idx] = 0;
+            break;
+        case CmdType::Amp:
+            tones.amp[idx] = cmd.val;
+            tones.damp[idx] = 0;
+            tones.ddamp[idx] = 0;
+            break;
+        case CmdType::FreqRamp:
+            tones.dfreq[idx] = freq_to_fixed(cmd.val);
+            tones.ddfreq[idx] = 0;
+            break;
+        case CmdType::AmpRamp:
+            tones.damp[idx] = cmd.val;
+            tones.ddamp[idx] = 0;
+            break;
+        case CmdType::Hold:
+            tones.dfreq[idx] = 0;
+            tones.damp[idx] = 0;
+            tones.ddfreq[idx] = 0;
+            tones.ddamp[idx] = 0;
+            break;
+        case CmdType::FreqRamp2:
+            tones.ddfreq[idx] = freq_to_fixed(cmd.val);
+            break;
+        case CmdType::AmpRamp2:
+            tones.ddamp[idx] = cmd.val;
+            break;
+        case CmdType::EnvShape:
+            tones.env[idx].shape = uint8_t(cmd.val);
+            break;
+        case CmdType::EnvRise:
+        case CmdType::EnvFall: {
+            auto &env = tones.env[idx];
+            // Full steps so that the end of the envelope is at a step boundary.
+            env.len = uint32_t(std::max(std::round(cmd.val / step_size), 1.0)) * step_size;
+            env.t = 0;
+            env.fall = cmd.op == CmdType::EnvFall;
+            break;
+        }
+        }
+    }
+    if (m_block_cache && state.cmd_idx != cmd_idx0) {
+        state.seg_t = state.t;
+        state.seg_hash = tones.hash();
+    }
+}
+
+void DataStream::update_active(GenState &state) const
+{
+    auto &tones = state.tones;
+    int ramp_order = 0;
+    bool has_env = false;
+    for (uint32_t c = 0; c < m_nchns; c++) {
+        int nactive = 0;
+        auto active = &state.active[c * m_ntones];
+        auto params = &state.params[c * m_ntones];
+        for (uint32_t i = c * m_ntones; i < (c + 1) * m_ntones; i++) {
+            if (tones.dfreq[i] != 0 || tones.damp[i] != 0)
+                ramp_order = std::max(ramp_order, 1);
+            if (tones.ddfreq[i] != 0 || tones.ddamp[i] != 0 || tones.env[i].len) {
+                ramp_order = 2;
+                has_env |= tones.env[i].len != 0;
+            }
+            if (tones.amp[i] == 0 && tones.damp[i] == 0 && tones.ddamp[i] == 0)
+                continue;
+            active[nactive] = i;
+            // Only used when none of the tones are ramping.
+            // The phase is filled in for each step.
+            params[nactive].freq = fixed_to_freq(tones.freq[i]);
+            params[nactive].amp = float(tones.amp[i] * amp_scale);
+            nactive++;
+        }
+        state.nactive[c] = nactive;
+    }
+    if (ramp_order == 1) {
+        // Sort the active tones by the ramps they use (see `channel_param_groups`)
+        // so that the generator only computes the ramps for the tones that need them.
+        // `params` isn't used in this case so it doesn't need to be sorted too.
+        auto ramps = [&] (uint32_t i) {
+            return int(tones.dfreq[i] != 0) | (int(tones.damp[i] != 0) << 1);
+        };
+        for (uint32_t c = 0; c < m_nchns; c++) {
+            auto active = &state.active[c * m_ntones];
+            auto end = active + state.nactive[c];
+            auto fixed_end = std::partition(active, end,
+                                            [&] (uint32_t i) { return ramps(i) == 0; });
+            auto freq_end = std::partition(fixed_end, end,
+                                           [&] (uint32_t i) { return ramps(i) == 1; });
+            auto amp_end = std::partition(freq_end, end,
+                                          [&] (uint32_t i) { return ramps(i) == 2; });
+            state.groups[c] = {&state.ramp_params[c * m_ntones], int(fixed_end - active),
+                               int(freq_end - active), int(amp_end - active)};
+        }
+    }
+    state.ramp_order = ramp_order;
+    state.has_env = has_env;
+    state.changed = false;
+}
+
+void DataStream::step(GenState &state, int16_t *out) const
+{
+    apply_cmds(state);
+    if (state.changed)
+        update_active(state);
+    auto &gen = host_gens[int(m_prec)];
+    auto &tones = state.tones;
+    auto log2_nchns = __builtin_ctz(m_nchns);
+    // The phase of sample `i` in the step is
+    // `phase + freq * i + dfreq * i * (i - 1) / 2 + ddfreq * i * (i - 1) * (i - 2) / 6`,
+    // and the generators use the powers of `i` for the ramp terms.
+    // Similarly for the amplitude.
+    if (state.ramp_order == 2) {
+        const channel_param_ramp2 *ramp2_params[4];
+        for (uint32_t c = 0; c < m_nchns; c++) {
+            auto active = &state.active[c * m_ntones];
+            auto params = &state.ramp2_params[c * m_ntones];
+            for (int k = 0; k < state.nactive[c]; k++) {
+                auto i = active[k];
+                auto freq = uint64_t(tones.freq[i]);
+                auto dfreq = tones.dfreq[i];
+                auto ddfreq = tones.ddfreq[i];
+                auto &p = params[k];
+                p.phase = fixed_to_phase(tones.phase[i]);
+                p.freq = fixed_to_freq(int64_t(freq - uint64_t(dfreq / 2) +
+                                               uint64_t(ddfreq / 3)));
+                p.dfreq = fixed_to_dfreq(int64_t(uint64_t(dfreq) - uint64_t(ddfreq)));
+                p.ddfreq = fixed_to_ddfreq(ddfreq);
+                if (tones.env[i].len) {
+                    // Interpolate the amplitude with the envelope quadratically
+                    // over the step from the beginning, the middle and the end.
+                    auto a0 = tones.amp_at(i, 0);
+                    auto a1 = tones.amp_at(i, step_size / 2);
+                    auto a2 = tones.amp_at(i, step_size);
+                    p.amp = float(a0 * amp_scale);
+                    p.damp = float((4 * a1 - 3 * a0 - a2) * (amp_scale / 2));
+                    p.ddamp = float((a2 - 2 * a1 + a0) * amp_scale);
+                }
+                else {
+                    p.amp = float(tones.amp[i] * amp_scale);
+                    p.damp = float((tones.damp[i] - tones.ddamp[i] / 2) * (amp_scale * 16));
+                    p.ddamp = float(tones.ddamp[i] * (amp_scale * 256));
+                }
+            }
+            ramp2_params[c] = params;
+        }
+        gen.run_wave_ramp2[log2_nchns](out, step_size, 1, state.nactive.get(),
+                                       ramp2_params);
+    }
+    else if (state.ramp_order == 1) {
+        const channel_param_groups *groups[4];
+        for (uint32_t c = 0; c < m_nchns; c++) {
+            auto active = &state.active[c * m_ntones];
+            auto params = &state.ramp_params[c * m_ntones];
+            for (int k = 0; k < state.nactive[c]; k++) {
+                auto i = active[k];
+                params[k] = {fixed_to_phase(tones.phase[i]),
+                             fixed_to_freq(int64_t(uint64_t(tones.freq[i]) -
+                                                   uint64_t(tones.dfreq[i] / 2))),
+                             fixed_to_dfreq(tones.dfreq[i]),
+                             float(tones.amp[i] * amp_scale),
+                             float(tones.damp[i] * (amp_scale * 16))};
+            }
+            groups[c] = &state.groups[c];
+        }
+        gen.run_wave_groups[log2_nchns](out, step_size, 1, state.nactive.get(), groups);
+    }
+    else {
+        // Only the phase changes between the steps.
+        const channel_param_fixed *params[4];
+        for (uint32_t c = 0; c < m_nchns; c++) {
+            auto active = &state.active[c * m_ntones];
+            auto ps = &state.params[c * m_ntones];
+            for (int k = 0; k < state.nactive[c]; k++)
+                ps[k].phase = fixed_to_phase(tones.phase[active[k]]);
+            params[c] = ps;
+        }
+        gen.run_wave_fixed[log2_nchns](out, step_size, 1, state.nactive.get(), params);
+    }
+    state.forward(step_size);
+    state.t += step_size;
+}
+
+bool DataStream::fft_step(GenState &state, int16_t *out) const
+{
+    auto &gen = host_gens[int(m_prec)];
+    if (m_ntones < uint32_t(gen.fft_min_tones))
+        return false;
+    apply_cmds(state);
+    // The next command must not take effect before the end of the block.
+    if (state.cmd_idx < m_cmds.size() &&
+        m_cmds[state.cmd_idx].t <= state.t + FFTSynth::block_size - step_size)
+        return false;
+    if (state.changed)
+        update_active(state);
+    if (state.ramp_order != 0)
+        return false;
+    size_t nactive = 0;
+    for (uint32_t c = 0; c < m_nchns; c++)
+        nactive += size_t(state.nactive[c]);
+    if (nactive < size_t(gen.fft_min_tones) * m_nchns)
+        return false;
+    if (!state.fft)
+        state.fft.reset(new FFTState);
+    auto &fft = *state.fft;
+    auto &tones = state.tones;
+    for (uint32_t c = 0; c < m_nchns; c++) {
+        fft.tones.clear();
+        auto active = &state.active[c * m_ntones];
+        for (int k = 0; k < state.nactive[c]; k++) {
+            auto i = active[k];
+            fft.tones.push_back({double(tones.phase[i]) * 0x1p-64,
+                                 double(tones.freq[i]) * 0x1p-64, tones.amp[i] * 32767});
+        }
+        fft.synth[c].run(fft.out, fft.tones.data(), int(fft.tones.size()));
+        for (int i = 0; i < FFTSynth::block_size; i++) {
+            // Round and saturate the same way as the generators.
+            auto v = std::min(std::max(fft.out[i], -32768.0f), 32767.0f);
+            out[i * m_nchns + c] = int16_t(std::nearbyint(v));
+        }
+    }
+    state.forward(FFTSynth::block_size);
+    state.t += FFTSynth::block_size;
+    return true;
+}
+
+size_t DataStream::cache_steps(GenState &state, int16_t *out, size_t nsteps) const
+{
+    apply_cmds(state);
+    if (state.changed)
+        update_active(state);
+    if (state.ramp_order != 0)
+        return 0;
+    // Number of steps until the next command takes effect.
+    auto hold_steps = UINT64_MAX;
+    if (state.cmd_idx < m_cmds.size())
+        hold_steps = (m_cmds[state.cmd_idx].t - state.t + step_size - 1) / step_size;
+    nsteps = size_t(std::min<uint64_t>(nsteps, hold_steps));
+    if (!state.cache)
+        state.cache.reset(new PeriodCache);
+    auto &cache = *state.cache;
+    auto &tones = state.tones;
+    if (cache.version != state.version) {
+        cache.version = state.version;
+        cache.data = OutBuffer();
+        uint64_t period = 1;
+        for (uint32_t c = 0; c < m_nchns && period; c++) {
+            auto active = &state.active[c * m_ntones];
+            for (int k = 0; k < state.nactive[c]; k++) {
+                auto q = freq_period(tones.freq[active[k]], max_cache_period);
+                if (!q) {
+                    period = 0;
+                    break;
+                }
+                auto a = period;
+                auto b = q;
+                while (b) {
+                    a = a % b;
+                    std::swap(a, b);
+                }
+                period = period / a * q;
+                if (period > max_cache_period) {
+                    period = 0;
+                    break;
+                }
+            }
+        }
+        if (period)
+            period *= (min_cache_len + period - 1) / period;
+        cache.period = period;
+        // The frequencies are only periods within the tolerance of `freq_period`
+        // so the error accumulates each time the period is repeated.
+        uint64_t err = 0;
+        for (uint32_t c = 0; c < m_nchns && period; c++) {
+            auto active = &state.active[c * m_ntones];
+            for (int k = 0; k < state.nactive[c]; k++) {
+                auto e = uint64_t(tones.freq[active[k]]) * period;
+                err = std::max(err, std::min(e, -e));
+            }
+        }
+        cache.max_len = err ? max_cache_drift / err * period : UINT64_MAX;
+    }
+    if (!cache.period || !nsteps)
+        return 0;
+    // Too far from where the period was computed.
+    if (!cache.data.empty() && state.t - cache.t0 + step_size > cache.max_len)
+        cache.data = OutBuffer();
+    if (cache.data.empty()) {
+        // Computing the period costs as much as generating it so only do it
+        // if it can be copied at least once before the next command.
+        auto period_steps = (cache.period + step_size - 1) / step_size;
+        if (hold_steps < period_steps * 2)
+            return 0;
+        // Compute it from the current state and then rewind the tones,
+        // which only changes the phases since all the tones are constant.
+        cache.data = OutBuffer(period_steps * step_size * m_nchns);
+        cache.t0 = state.t;
+        auto phase = tones.phase;
+        for (uint64_t i = 0; i < period_steps; )
+            i += fixed_steps(state, &cache.data.data()[i * step_size * m_nchns],
+                             size_t(period_steps - i));
+        tones.phase = std::move(phase);
+        state.t = cache.t0;
+    }
+    if (cache.max_len != UINT64_MAX)
+        nsteps = size_t(std::min<uint64_t>(nsteps, (cache.max_len - (state.t - cache.t0)) /
+                                           step_size));
+    uint64_t nsamples = nsteps * step_size;
+    auto offset = (state.t - cache.t0) % cache.period;
+    for (uint64_t i = 0; i < nsamples;) {
+        auto n = std::min(nsamples - i, cache.period - offset);
+        memcpy(&out[i * m_nchns], &cache.data.data()[offset * m_nchns],
+               n * m_nchns * sizeof(int16_t));
+        i += n;
+        offset = 0;
+    }
+    state.forward(nsamples);
+    state.t += nsamples;
+    return nsteps;
+}
+
+size_t DataStream::block_steps(GenState &state, int16_t *out, size_t nsteps) const
+{
+    // The periodic output is already cheap to generate.
+    if (auto n = cache_steps(state, out, nsteps))
+        return n;
+    // The output until the next command only depends on the tones at the last command
+    // and the time since then.
+    constexpr uint64_t block_size = cache_block_steps * step_size;
+    auto block_idx = (state.t - state.seg_t) / block_size;
+    auto block_t = state.seg_t + block_idx * block_size;
+    auto block_end = block_t + block_size;
+    if (state.cmd_idx < m_cmds.size()) {
+        auto cmd_t = (m_cmds[state.cmd_idx].t + step_size - 1) / step_size * step_size;
+        block_end = std::min(block_end, cmd_t);
+    }
+    auto key = hash_combine(hash_combine(state.seg_hash, block_idx), block_end - block_t);
+    key = hash_combine(key, uint64_t(m_prec));
+    nsteps = size_t(std::min<uint64_t>(nsteps, (block_end - state.t) / step_size));
+    auto &cache = *m_block_cache;
+    if (auto data = cache.get(key)) {
+        memcpy(out, &data->data()[(state.t - block_t) * m_nchns],
+               nsteps * step_size * m_nchns * sizeof(int16_t));
+        skip(state, nsteps);
+        return nsteps;
+    }
+    // Only the whole blocks are cached.
+    if (state.t != block_t) {
+        render_steps(state, out, nsteps);
+        return nsteps;
+    }
+    auto block_steps = size_t(block_end - block_t) / step_size;
+    if (nsteps == block_steps) {
+        render_steps(state, out, nsteps);
+        auto data = std::make_shared<OutBuffer>(nsteps * step_size * m_nchns);
+        memcpy(data->data(), out, data->size() * sizeof(int16_t));
+        cache.put(key, std::move(data));
+        return nsteps;
+    }
+    // Compute the whole block even though only the beginning of it is needed
+    // so that the rest can be copied from the cache when the next output is generated.
+    // There's no command in the block so only the tones need to be restored.
+    auto data = std::make_shared<OutBuffer>(block_steps * step_size * m_nchns);
+    auto tones = state.tones;
+    render_steps(state, data->data(), block_steps);
+    state.tones = std::move(tones);
+    state.t = block_t;
+    state.changed = true;
+    skip(state, nsteps);
+    memcpy(out, data->data(), nsteps * step_size * m_nchns * sizeof(int16_t));
+    cache.put(key, std::move(data));
+    return nsteps;
+}
+
+size_t DataStream::fixed_steps(GenState &state, int16_t *out, size_t nsteps) const
+{
+    apply_cmds(state);
+    if (state.changed)
+        update_active(state);
+    if (state.ramp_order != 0)
+        return 0;
+    if (state.cmd_idx < m_cmds.size()) {
+        auto hold_steps = (m_cmds[state.cmd_idx].t - state.t + step_size - 1) / step_size;
+        nsteps = size_t(std::min<uint64_t>(nsteps, hold_steps));
+    }
+    nsteps = std::min(nsteps, max_batch_steps);
+    if (!nsteps)
+        return 0;
+    auto &gen = host_gens[int(m_prec)];
+    auto &tones = state.tones;
+    auto log2_nchns = __builtin_ctz(m_nchns);
+    channel_param_fixed *params[4];
+    const uint32_t *phase[4];
+    const uint32_t *dphase[4];
+    for (uint32_t c = 0; c < m_nchns; c++) {
+        auto active = &state.active[c * m_ntones];
+        auto ph = &state.step_phase[c * m_ntones];
+        auto dph = &state.step_dphase[c * m_ntones];
+        // Round the phase and its change per step to the nearest 32bit fixed point number.
+        for (int k = 0; k < state.nactive[c]; k++) {
+            auto i = active[k];
+            ph[k] = uint32_t((tones.phase[i] + (uint64_t(1) << 31)) >> 32);
+            dph[k] = uint32_t((uint64_t(tones.freq[i]) * step_size +
+                               (uint64_t(1) << 31)) >> 32);
+        }
+        params[c] = &state.params[c * m_ntones];
+        phase[c] = ph;
+        dphase[c] = dph;
+    }
+    run_wave_steps_t run_ntones = nullptr;
+    if (m_nchns == 1 && state.nactive[0] > 0 && state.nactive[0] <= max_unroll_tones)
+        run_ntones = gen.run_wave_steps_ntones[state.nactive[0] - 1];
+    if (run_ntones) {
+        run_ntones(out, nsteps, state.nactive.get(), params, phase, dphase);
+    }
+    else {
+        gen.run_wave_steps[log2_nchns](out, nsteps, state.nactive.get(), params,
+                                       phase, dphase);
+    }
+    state.forward(nsteps * step_size);
+    state.t += nsteps * step_size;
+    return nsteps;
+}
+
+void DataStream::render_steps(GenState &state, int16_t *out, size_t nsteps) const
+{
+    size_t i = 0;
+    while (i < nsteps) {
+        if (auto n = cache_steps(state, &out[i * step_size * m_nchns], nsteps - i)) {
+            i += n;
+            continue;
+        }
+        if (nsteps - i >= fft_steps && fft_step(state, &out[i * step_size * m_nchns])) {
+            i += fft_steps;
+            continue;
+        }
+        if (auto n = fixed_steps(state, &out[i * step_size * m_nchns], nsteps - i)) {
+            i += n;
+            continue;
+        }
+        step(state, &out[i * step_size * m_nchns]);
+        i++;
+    }
+}
+
+void DataStream::gen_steps(GenState &state, int16_t *out, size_t nsteps) const
+{
+    if (!m_block_cache) {
+        render_steps(state, out, nsteps);
+        return;
+    }
+    for (size_t i = 0; i < nsteps; )
+        i += block_steps(state, &out[i * step_size * m_nchns], nsteps - i);
+}
+
+void DataStream::skip(GenState &state, size_t nsteps) const
+{
+    auto end = state.t + nsteps * step_size;
+    while (state.t < end) {
+        apply_cmds(state);
+        // The tones evolve independently until the step at which the next command applies.
+        auto next = end;
+        if (state.cmd_idx < m_cmds.size()) {
+            auto cmd_t = (m_cmds[state.cmd_idx].t + step_size - 1) / step_size * step_size;
+            next = std::min(next, cmd_t);
+        }
+        // Same as the sum of the per step update in `step` since the fixed point
+        // arithmetic is exact.
+        if (state.changed)
+            update_active(state);
+        state.forward(next - state.t);
+        state.t = next;
+    }
+}
+
+NACS_EXPORT() void DataStream::generate(int16_t *out, size_t nsteps)
+{
+    if ((uintptr_t)out % 64 != 0)
+        throw std::invalid_argument("DataStream: output buffer not aligned");
+    fetch_cmds();
+    auto nworkers = m_workers.size();
+    if (nworkers == 0 || nsteps < nworkers * min_worker_steps) {
+        gen_steps(m_state, out, nsteps);
+        return;
+    }
+    // Start each worker as soon as the state at the beginning of its slice is known
+    // so that computing the state for the next worker overlaps with the generation.
+    size_t start = 0;
+    for (size_t w = 0; w < nworkers; w++) {
+        auto &worker = *m_workers[w];
+        size_t end = nsteps * (w + 1) / nworkers;
+        worker.state.tones = m_state.tones;
+        worker.state.t = m_state.t;
+        worker.state.cmd_idx = m_state.cmd_idx;
+        worker.state.changed = true;
+        worker.state.version = m_state.version;
+        worker.state.seg_t = m_state.seg_t;
+        worker.state.seg_hash = m_state.seg_hash;
+        worker.start(&out[start * step_size * m_nchns], end - start);
+        skip(m_state, end - start);
+        start = end;
+    }
+    for (auto &worker: m_workers) {
+        worker->wait();
+    }
+}
+
+NACS_EXPORT() size_t DataStream::generate(DMABuffer &buff, size_t max_steps)
+{
+    auto span = buff.get_span();
+    auto step_bytes = step_size * m_nchns * sizeof(int16_t);
+    auto nsteps = std::min(span.size / step_bytes, max_steps);
+    if (!nsteps)
+        return 0;
+    generate((int16_t*)span.data, nsteps);
+    buff.commit(nsteps * step_bytes);
+    return nsteps;
+}
+
 }
 }
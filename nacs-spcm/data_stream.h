@@ -19,9 +19,284 @@
 #ifndef _NACS_SPCM_DATA_STREAM_H
 #define _NACS_SPCM_DATA_STREAM_H
 
+#include <nacs-utils/utils.h>
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace NaCs {
 namespace Spcm {
 
+class DMABuffer;
+struct channel_param_fixed;
+struct channel_param_packed;
+struct channel_param_ramp2;
+struct channel_param_groups;
+
+// Turn a time ordered stream of per-tone commands into a continuous stream of
+// 16bit samples.
+// The output is computed `step_size` (32) samples at a time, all times are in unit of
+// samples and a command takes effect at the first step boundary at or after its time.
+// When there are many constant tones, the output is computed 1024 samples at a time
+// with an inverse FFT instead, which gives the same output within the 16bit resolution.
+// When all the tones are constant and their frequencies are multiples of a common base
+// (within `2^-52` cycles per sample), one period of the output is computed
+// and copied for the rest of the hold. It is computed again from the exact phase
+// before the accumulated error of the period reaches `2^-26` cycles.
+// Commands can be added from any thread while another one is generating the output.
+class DataStream {
+public:
+    enum class CmdType : uint8_t {
+        Phase, // Set the phase, in unit of cycles.
+        Freq, // Set the frequency, in unit of cycles per sample, must be in (-0.5, 0.5).
+        Amp, // Set the amplitude, in unit of the full scale of the output.
+        // Ramp the frequency linearly, in unit of cycles per sample per sample,
+        // must be in (-0.5, 0.5). The frequency wraps around at +-0.5 cycles per sample.
+        FreqRamp,
+        // Ramp the amplitude linearly, in unit of the full scale of the output per sample.
+        AmpRamp,
+        // Stop all ramps of the tone and keep the current values. `val` is ignored.
+        Hold,
+        // Ramp the frequency ramp (`FreqRamp`) linearly starting from its current value,
+        // i.e. a cubic phase, in unit of cycles per sample^3, must be in (-0.5, 0.5).
+        FreqRamp2,
+        // Ramp the amplitude ramp (`AmpRamp`) linearly starting from its current value,
+        // in unit of the full scale of the output per sample^2.
+        AmpRamp2,
+        // Set the shape (`Envelope`) used by the following `EnvRise` and `EnvFall`.
+        // The default is `Envelope::Cosine`.
+        EnvShape,
+        // Multiply the amplitude by an envelope rising from 0 to 1 over `val` samples.
+        // The duration is rounded to a multiple of 32 samples.
+        // The envelope is interpolated quadratically within each step, which is accurate
+        // to ~1 LSB for envelopes longer than ~1000 samples (~2000 for `Erf`).
+        EnvRise,
+        // Same as `EnvRise` but falling from 1 to 0. The amplitude and its ramps
+        // are set to 0 at the end.
+        EnvFall,
+    };
+    // The shapes of the amplitude envelopes, as the value of the `EnvShape` command.
+    // Each of them rises smoothly from 0 to 1.
+    enum class Envelope : uint8_t {
+        Cosine, // `(1 - cos(pi * x)) / 2`
+        Blackman, // The rising half of the Blackman window.
+        Erf, // `erf` from -3 to 3, scaled to start and end at exactly 0 and 1.
+        _Num,
+    };
+    // The accuracy of the sine function used by the generators.
+    // The errors are the maximum for the output of a single full scale tone
+    // and the FFT synthesizer is only used by `Default` and `Low`.
+    enum class Precision : uint8_t {
+        Low, // Lower degree polynomial, up to ~4 LSB of error and ~10% faster.
+        Default, // Up to ~0.2 LSB of error.
+        // Sleef's `sinpif` with the whole cycles removed from the phase
+        // before the rounding, up to ~0.015 LSB of error. Several times slower.
+        High,
+    };
+    // The parameters are updated at the first step boundary (multiple of 32 samples)
+    // at or after `t`. A ramp continues until the next command that sets or ramps
+    // the same parameter or until a `Hold` on the tone.
+    // Setting a parameter or its ramp stops the higher order ramps of the same parameter.
+    // The envelopes are independent of the amplitude commands and its ramps.
+    // Only the commands are stored so that long sequences with many tones
+    // can be streamed without materializing the per-step parameters.
+    struct Cmd {
+        uint64_t t;
+        uint32_t chn;
+        CmdType op;
+        double val;
+    };
+
+    // `ntones` tones for each of the `nchns` output channels of the card (1, 2 or 4).
+    // Tone `i` of channel `c` has the index `c * ntones + i` in the commands.
+    DataStream(uint32_t ntones, uint32_t nchns=1);
+    ~DataStream();
+
+    // Number of tones per channel.
+    uint32_t ntones() const
+    {
+        return m_ntones;
+    }
+    uint32_t nchns() const
+    {
+        return m_nchns;
+    }
+    // Time of the next sample to be generated.
+    uint64_t cur_t() const
+    {
+        return m_state.t;
+    }
+
+    // Name of the generator implementation selected for the host.
+    static const char *gen_name();
+
+    // Commands must be added in time order.
+    void add_cmd(const Cmd &cmd);
+    void add_cmds(const Cmd *cmds, size_t ncmds);
+    // Generate `nsteps * 32` samples of all the channels to `out`,
+    // which must be 64 bytes aligned.
+    // The channels are interleaved in the sample order of the card.
+    void generate(int16_t *out, size_t nsteps);
+    // Generate at most `max_steps` steps directly into the writable span of `buff`
+    // and commit it to the card. Returns the number of steps generated.
+    size_t generate(DMABuffer &buff, size_t max_steps=SIZE_MAX);
+
+    // Use one worker thread for each of the entries in `cpus` to generate the output.
+    // Each worker is pinned to the CPU in the corresponding entry (or not pinned if it is
+    // negative) and generates a contiguous slice of the steps of each `generate` call,
+    // writing directly to its part of the output buffer.
+    // An empty list generates everything on the calling thread.
+    // Must not be called concurrently with `generate`.
+    void set_workers(const std::vector<int> &cpus);
+    struct WorkerStats {
+        uint64_t nsteps;
+        uint64_t time; // Time spent generating, in ns.
+    };
+    std::vector<WorkerStats> worker_stats() const;
+
+    // Must not be called concurrently with `generate`.
+    void set_precision(Precision prec);
+    Precision precision() const
+    {
+        return m_prec;
+    }
+
+    // Cache the output in blocks of up to 64 steps aligned to the last command
+    // and keyed on a hash of the state of all the tones at the last command,
+    // the position of the block and its length,
+    // so that the output repeated in every shot of an experiment is only computed once.
+    // At most `max_bytes` of the output is kept and the least recently used block
+    // is dropped first. 0 (the default) disables the cache.
+    // Must not be called concurrently with `generate`.
+    void set_block_cache(size_t max_bytes);
+    struct BlockCacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t nblocks;
+        size_t bytes;
+    };
+    BlockCacheStats block_cache_stats() const;
+
+private:
+    // The state of all the tones with one array for each field
+    // so that they can be moved forward together in a single pass (`forward`)
+    // instead of one tone at a time.
+    // The phase and frequency are fixed point numbers with `2^64` being a full cycle
+    // so that the phase can be accumulated exactly over arbitrarily long time.
+    struct Tones {
+        Tones(uint32_t ntones);
+        // The envelope in progress, see `EnvRise` and `EnvFall`.
+        struct Env {
+            uint32_t len; // 0 if there's none.
+            uint32_t t; // Number of samples since the start of the envelope.
+            uint8_t shape;
+            bool fall;
+        };
+        std::vector<uint64_t> phase;
+        std::vector<int64_t> freq; // per sample
+        std::vector<int64_t> dfreq; // per sample per sample
+        std::vector<int64_t> ddfreq; // per sample^3
+        std::vector<double> amp;
+        std::vector<double> damp; // per sample
+        std::vector<double> ddamp; // per sample^2
+        std::vector<Env> env;
+        // The amplitude of tone `idx` `i` samples later including the envelope.
+        double amp_at(uint32_t idx, int i) const;
+        // Hash of all the fields, used as the key of the block cache.
+        uint64_t hash() const;
+    };
+    struct FFTState;
+    struct PeriodCache;
+    struct BlockCache;
+    // Everything needed to generate the output starting from time `t`.
+    // Each worker has its own copy for the slice of the output it generates.
+    struct GenState {
+        GenState(uint32_t ntones, uint32_t nchns);
+        Tones tones;
+        uint64_t t = 0;
+        // Index of the next command to apply.
+        size_t cmd_idx = 0;
+        // Set when the tones are changed by a command or at the end of an envelope
+        // so that the fields below are updated (`update_active`) before they are used.
+        bool changed = true;
+        // Incremented for each change of the tones other than moving them forward
+        // so that the periodic output cached for the current tones can be reused
+        // by a worker with a copy of the state.
+        uint64_t version = 0;
+        // Time of the last command and the hash of the tones right after it,
+        // only computed when the block cache is enabled.
+        uint64_t seg_t = 0;
+        uint64_t seg_hash = 0;
+        // The highest order of the ramps of all the tones, 0 when all of them are constant
+        // and 2 for the second order ramps or the envelopes.
+        int ramp_order = 0;
+        bool has_env = false;
+        // The indices of the active tones of channel `c` are stored starting at index
+        // `c * ntones` and the numbers of them are in `nactive`.
+        std::unique_ptr<uint32_t[]> active;
+        std::unique_ptr<int[]> nactive;
+        // The parameters of the active tones for the generator. The frequency and amplitude
+        // are only updated with the active tones and the phase is updated for each step.
+        std::unique_ptr<channel_param_fixed[]> params;
+        // Only used when at least one of the tones is ramping.
+        std::unique_ptr<channel_param_packed[]> ramp_params;
+        // Only used when at least one of the tones has a second order ramp.
+        std::unique_ptr<channel_param_ramp2[]> ramp2_params;
+        // With only first order ramps, the active tones are sorted by the ramps they use
+        // and the boundaries of the groups for each channel are stored here.
+        std::unique_ptr<channel_param_groups[]> groups;
+        // The 32bit phases and their changes per step of the active tones
+        // for generating multiple steps of constant tones at once (`fixed_steps`).
+        std::unique_ptr<uint32_t[]> step_phase;
+        std::unique_ptr<uint32_t[]> step_dphase;
+        // Allocated when the FFT synthesizer is first used.
+        std::unique_ptr<FFTState> fft;
+        // Allocated when the tones are first checked for a periodic output.
+        std::unique_ptr<PeriodCache> cache;
+        // Move the tones forward by `nsamples`, which must be even.
+        void forward(uint64_t nsamples);
+    };
+    struct Worker;
+    void check_cmd(const Cmd &cmd);
+    void fetch_cmds();
+    void apply_cmds(GenState &state) const;
+    void update_active(GenState &state) const;
+    void step(GenState &state, int16_t *out) const;
+    // Generate `FFTSynth::block_size` samples at once if all the tones are constant
+    // for the whole block and there are enough of them for the FFT to be faster.
+    bool fft_step(GenState &state, int16_t *out) const;
+    // Generate at most `nsteps` with a single call to the generator
+    // if all the tones are constant. Returns the number of steps generated.
+    size_t fixed_steps(GenState &state, int16_t *out, size_t nsteps) const;
+    // Copy the output from the cached period for at most `nsteps` if all the tones
+    // are constant and periodic. Returns the number of steps generated.
+    size_t cache_steps(GenState &state, int16_t *out, size_t nsteps) const;
+    // Generate the output for at most `nsteps` from the block cache,
+    // or compute it and add it to the cache. Returns the number of steps generated.
+    size_t block_steps(GenState &state, int16_t *out, size_t nsteps) const;
+    void render_steps(GenState &state, int16_t *out, size_t nsteps) const;
+    void gen_steps(GenState &state, int16_t *out, size_t nsteps) const;
+    // Move the state forward by `nsteps` without generating the output.
+    void skip(GenState &state, size_t nsteps) const;
+
+    const uint32_t m_ntones;
+    const uint32_t m_nchns;
+    GenState m_state;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::unique_ptr<BlockCache> m_block_cache;
+    Precision m_prec = Precision::Default;
+
+    // Commands that are visible to the generator.
+    std::vector<Cmd> m_cmds;
+
+    // Commands added by `add_cmd(s)`, protected by `m_cmd_lock`.
+    std::mutex m_cmd_lock;
+    std::vector<Cmd> m_new_cmds;
+    uint64_t m_last_t = 0;
+};
 
 }
 }
@@ -21,22 +21,88 @@
 
 #include "data_stream.h"
 
+#include <nacs-utils/processor.h>
 #include <nacs-utils/utils.h>
 
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+
 #if NACS_CPU_X86 || NACS_CPU_X86_64
 #  include <immintrin.h>
 #elif NACS_CPU_AARCH64
 #  include <arm_neon.h>
+// The SVE intrinsics with the `target` attribute require GCC 10.
+#  if !defined(__clang__) && __GNUC__ >= 10
+#    include <arm_sve.h>
+#    define NACS_SPCM_SVE 1
+#  endif
 #endif
 
+// Sleef is only used for `Precision::High`.
+// The declarations in `sleef.h` depend on the target of the whole file
+// so the ones for the instruction sets enabled with the `target` attribute
+// are declared here instead.
+extern "C" {
+float Sleef_sinpif_u05(float);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+__attribute__((target("sse2"))) __m128 Sleef_sinpif4_u05sse2(__m128);
+__attribute__((target("avx"))) __m256 Sleef_sinpif8_u05avx(__m256);
+__attribute__((target("avx2,fma"))) __m256 Sleef_sinpif8_u05avx2(__m256);
+__attribute__((target("avx512f"))) __m512 Sleef_sinpif16_u05avx512f(__m512);
+#elif NACS_CPU_AARCH64
+float32x4_t Sleef_sinpif4_u05advsimd(float32x4_t);
+#  ifdef NACS_SPCM_SVE
+__attribute__((target("+sve"))) svfloat32_t Sleef_sinpifx_u05sve(svfloat32_t);
+#  endif
+#endif
+}
+
 namespace NaCs {
 namespace Spcm {
 
 namespace {
 
+using Precision = DataStream::Precision;
+
 // This is the number of samples we compute on a linear amplitude and frequency slope.
+// The generators can also be instantiated for the other step sizes in `StepSize`
+// (the `S` template parameter): longer steps load the parameters less often
+// while shorter ones allow the frequency and amplitude to be updated more frequently.
 constexpr int step_size = 32;
 
+// The phase (in unit of pi) of sample `i` in a step for a frequency of 1
+// (i.e. one full cycle per step) and the same for the quadratic and cubic terms
+// of the ramps. All are exact in single precision for the supported step sizes.
+template<int S>
+struct StepSize {
+    static_assert(S == 16 || S == 32 || S == 64 || S == 128, "Unsupported step size");
+    static constexpr float tidx(int i)
+    {
+        return float(i) * (2.0f / S);
+    }
+    static constexpr float tidx_2(int i)
+    {
+        return float(i * i) * (2.0f / (S * S));
+    }
+    static constexpr float tidx_3(int i)
+    {
+        return float(i * i * i) * (2.0f / (S * S * S));
+    }
+    // Split `freq` into `hi + lo` where `hi` has few enough significant bits
+    // that `hi * tidx(i)` is exact.
+    static NACS_INLINE void split_freq(float freq, float &hi, float &lo)
+    {
+        constexpr uint32_t mask = ~uint32_t(S - 1);
+        uint32_t bits;
+        memcpy(&bits, &freq, sizeof(bits));
+        bits &= mask;
+        memcpy(&hi, &bits, sizeof(hi));
+        lo = freq - hi;
+    }
+};
+
 }
 
 template<typename T>
@@ -67,8 +133,14 @@ namespace scalar {
 // However, the input needs to be scaled anyway so we can fold the input scaling in there,
 // for the output, we can scale it once after all the channels are computed instead
 // of doing it once per channel.
+// `Precision::Low` drops the highest order term of the polynomial and
+// `Precision::High` uses Sleef's 0.5 ULP `sinpif` instead (with one more rounding
+// from the scaling by `1 / pi`), which is a function call and much slower.
+template<Precision prec = Precision::Default>
 static NACS_INLINE float sinpif_pi(float d)
 {
+    if (prec == Precision::High)
+        return Sleef_sinpif_u05(d) * float(1 / M_PI);
 #if NACS_CPU_X86 || NACS_CPU_X86_64
     int q = _mm_cvtss_si32(_mm_set_ss(d));
 #elif NACS_CPU_AARCH64
@@ -85,6 +157,11 @@ static NACS_INLINE float sinpif_pi(float d)
     if (q & 1)
         d = -d;
 
+    // Numerically optimized over [0, 0.5], the maximum error is ~3.6e-5,
+    // i.e. ~4 LSB of the output for a full scale tone.
+    if (prec == Precision::Low)
+        return (s * d) * (0.74359607f * s - 1.6391299f) + d;
+
     // These coefficients are numerically optimized to
     // give the smallest maximum error over [0, 4] / [-4, 4]
     // The maximum error is ~4.08e-7.
@@ -95,30 +172,57 @@ static NACS_INLINE float sinpif_pi(float d)
     return (s * d) * u + d;
 }
 
-static constexpr float tidx_2[] = {
-    0.0, 0.001953125, 0.0078125, 0.017578125, 0.03125, 0.048828125, 0.0703125, 0.095703125,
-    0.125, 0.158203125, 0.1953125, 0.236328125, 0.28125, 0.330078125, 0.3828125, 0.439453125,
-    0.5, 0.564453125, 0.6328125, 0.705078125, 0.78125, 0.861328125, 0.9453125, 1.033203125,
-    1.125, 1.220703125, 1.3203125, 1.423828125, 1.53125, 1.642578125, 1.7578125, 1.876953125};
-static_assert(sizeof(tidx_2) == sizeof(float) * step_size, "");
+// `phase + tscale * freq` where `tscale` is `StepSize<S>::tidx`.
+// For `Precision::High`, the whole cycles are dropped from the exact product
+// with the high bits of the frequency before adding the rest
+// so that the rounding error is for a phase within `[-2, 2]`
+// rather than the phase at the end of the step, which dominates the error otherwise.
+template<int S, Precision prec>
+static NACS_INLINE float linear_phase(float tscale, float phase, float freq)
+{
+    if (prec != Precision::High)
+        return phase + tscale * freq;
+    float freq_hi, freq_lo;
+    StepSize<S>::split_freq(freq, freq_hi, freq_lo);
+    auto hi = tscale * freq_hi;
+    hi -= 2 * std::nearbyint(hi * 0.5f);
+    return (phase + hi) + tscale * freq_lo;
+}
 
 // Phase is in unit of pi
-// Frequency of 1 means one full cycle per 32 samples.
+// Frequency of 1 means one full cycle per step (`S` samples).
+template<int S = step_size, Precision prec = Precision::Default>
 static NACS_INLINE float calc_single_chn(int i, float phase, float freq, float amp,
-                                         float dfreq=0, float damp=0)
+                                         float dfreq=0, float damp=0,
+                                         float ddfreq=0, float ddamp=0)
 {
-    assume(0 <= i && i < step_size);
-    auto tscale = 0.0625f * (float)i;
-    auto tscale_2 = tidx_2[i];
-    phase += tscale * freq;
+    assume(0 <= i && i < S);
+    auto tscale = StepSize<S>::tidx(i);
+    auto tscale_2 = StepSize<S>::tidx_2(i);
+    phase = linear_phase<S, prec>(tscale, phase, freq);
     accum_nonzero(phase, tscale_2, dfreq);
+    accum_nonzero(phase, StepSize<S>::tidx_3(i), ddfreq);
     accum_nonzero(amp, tscale, damp);
-    return sinpif_pi(phase) * amp;
+    accum_nonzero(amp, tscale_2, ddamp);
+    return sinpif_pi<prec>(phase) * amp;
 }
 
-} // namespace scalar
+// Store the output either as `float` or as saturated 16bit integer.
+// The conversion to integer is done directly on the result of the computation
+// so that we don't need a separate pass over the output buffer.
+static NACS_INLINE void store(float *p, float v)
+{
+    *p = v;
+}
 
-#if NACS_CPU_X86 || NACS_CPU_X86_64
+static NACS_INLINE void store(int16_t *p, float v)
+{
+    v = v > 32767 ? 32767 : v;
+    v = v < -32768 ? -32768 : v;
+    *p = int16_t(lrintf(v));
+}
+
+} // namespace scalar
 
 // This is basically how GCC implements the corresponding intel intrinsics (`_mm*_set_ps`).
 // However, the intrinsics are not implemented as `constexpr`
@@ -134,11 +238,113 @@ static constexpr NACS_INLINE T set_ps(Args... args)
     return T{float(args)...};
 }
 
+template<int S>
+static constexpr NACS_INLINE float time_pow(int i, int order)
+{
+    return (order == 3 ? StepSize<S>::tidx_3(i) : order == 2 ? StepSize<S>::tidx_2(i) :
+            StepSize<S>::tidx(i));
+}
+
+template<typename V, int S, size_t... L>
+static constexpr NACS_INLINE V time_vec(int k, int order, std::index_sequence<L...>)
+{
+    return set_ps<V>(time_pow<S>(int(k * sizeof...(L) + L), order)...);
+}
+
+// `StepSize<S>::tidx`, `StepSize<S>::tidx_2` and `StepSize<S>::tidx_3`
+// for each vector of `W` samples in a step.
+// Use the plain vector type since the attributes on the intrinsic types
+// are ignored in template arguments.
+template<int W, int S, typename Seq=std::make_index_sequence<S / W>>
+struct TimeTable;
+template<int W, int S, size_t... K>
+struct TimeTable<W, S, std::index_sequence<K...>> {
+    typedef float vec __attribute__((vector_size(W * sizeof(float))));
+    static constexpr vec tidx[] = {
+        time_vec<vec, S>(int(K), 1, std::make_index_sequence<W>())...};
+    static constexpr vec tidx_2[] = {
+        time_vec<vec, S>(int(K), 2, std::make_index_sequence<W>())...};
+    static constexpr vec tidx_3[] = {
+        time_vec<vec, S>(int(K), 3, std::make_index_sequence<W>())...};
+};
+template<int W, int S, size_t... K>
+constexpr typename TimeTable<W, S, std::index_sequence<K...>>::vec
+TimeTable<W, S, std::index_sequence<K...>>::tidx[];
+template<int W, int S, size_t... K>
+constexpr typename TimeTable<W, S, std::index_sequence<K...>>::vec
+TimeTable<W, S, std::index_sequence<K...>>::tidx_2[];
+template<int W, int S, size_t... K>
+constexpr typename TimeTable<W, S, std::index_sequence<K...>>::vec
+TimeTable<W, S, std::index_sequence<K...>>::tidx_3[];
+
+namespace q15 {
+
+// The parameters of a tone for a step in fixed point for the integer generators.
+// The phase is in unit of `2^-31 pi` so that it wraps around naturally
+// and the frequency is the increment per sample (`dfreq` the coefficient of `i^2`).
+// The amplitude is in unit of `2^-16` of the 16bit output, including the `1 / pi`
+// of `sinpif_pi`, and `damp` is the increment per sample.
+// Both `phase` and `amp` include `2^15` so that the top 16 bits are rounded.
+struct Tone {
+    uint32_t phase;
+    uint32_t freq;
+    uint32_t dfreq;
+    int32_t amp;
+    int32_t damp;
+};
+
+// Round to the nearest integer and wrap around to 32 bits.
+static NACS_INLINE uint32_t cvt_wrap(float x)
+{
+#if NACS_CPU_X86_64
+    return uint32_t(_mm_cvtss_si64(_mm_set_ss(x)));
+#else
+    return uint32_t(llrintf(x));
+#endif
+}
+
+static NACS_INLINE int32_t cvt_i32(float x)
+{
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+    return _mm_cvtss_si32(_mm_set_ss(x));
+#else
+    return int32_t(lrintf(x));
+#endif
+}
+
+// The scaling of the phase and frequency are powers of 2 so they are exact in `float`.
+template<int S>
+static NACS_INLINE Tone tone(float phase, float freq, float amp, float dfreq=0, float damp=0)
+{
+    Tone t;
+    t.phase = cvt_wrap(phase * 2147483648.0f) + 0x8000;
+    t.freq = cvt_wrap(freq * (4294967296.0f / S));
+    t.dfreq = cvt_wrap(dfreq * (4294967296.0f / (S * S)));
+    t.amp = cvt_i32(amp * float(65536 / M_PI)) + 0x8000;
+    t.damp = cvt_i32(damp * float(131072 / M_PI / S));
+    return t;
+}
+
+// Coefficients of `sin(pi / 2 * w) = w + w * (c1 + c3 * w^2 + c5 * w^4 + c7 * w^6)`
+// in Q15, optimized for the smallest maximum error including the rounding
+// of all the operations in `sinpi_q15`, which is ~3.3 LSB.
+constexpr int16_t sin_c1 = 18707;
+constexpr int16_t sin_c3 = -21167;
+constexpr int16_t sin_c5 = 2612;
+constexpr int16_t sin_c7 = -153;
+
+} // namespace q15
+
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+
 namespace sse2 {
 
+template<Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("sse2")))
 __m128 sinpif_pi(__m128 d)
 {
+    if (prec == Precision::High)
+        return Sleef_sinpif4_u05sse2(d) * float(1 / M_PI);
     __m128i q = _mm_cvtps_epi32(d);
     d = d - _mm_cvtepi32_ps(q);
 
@@ -147,51 +353,110 @@ __m128 sinpif_pi(__m128 d)
     auto neg = _mm_cmpeq_epi32(q & _mm_set1_epi32(1), _mm_set1_epi32(1));
     d = __m128((neg & _mm_set1_epi32(0x80000000)) ^ __m128i(d));
 
+    if (prec == Precision::Low)
+        return (s * d) * (0.74359607f * s - 1.6391299f) + d;
     auto u = -0.17818783f * s + 0.8098674f;
     u = u * s - 1.6448531f;
     return (s * d) * u + d;
 }
 
-static constexpr __m128 tidx[] = {
-    set_ps<__m128>(0.0, 0.0625, 0.125, 0.1875), set_ps<__m128>(0.25, 0.3125, 0.375, 0.4375),
-    set_ps<__m128>(0.5, 0.5625, 0.625, 0.6875), set_ps<__m128>(0.75, 0.8125, 0.875, 0.9375),
-    set_ps<__m128>(1.0, 1.0625, 1.125, 1.1875), set_ps<__m128>(1.25, 1.3125, 1.375, 1.4375),
-    set_ps<__m128>(1.5, 1.5625, 1.625, 1.6875), set_ps<__m128>(1.75, 1.8125, 1.875, 1.9375)};
-static constexpr __m128 tidx_2[] = {
-    set_ps<__m128>(0.0, 0.001953125, 0.0078125, 0.017578125),
-    set_ps<__m128>(0.03125, 0.048828125, 0.0703125, 0.095703125),
-    set_ps<__m128>(0.125, 0.158203125, 0.1953125, 0.236328125),
-    set_ps<__m128>(0.28125, 0.330078125, 0.3828125, 0.439453125),
-    set_ps<__m128>(0.5, 0.564453125, 0.6328125, 0.705078125),
-    set_ps<__m128>(0.78125, 0.861328125, 0.9453125, 1.033203125),
-    set_ps<__m128>(1.125, 1.220703125, 1.3203125, 1.423828125),
-    set_ps<__m128>(1.53125, 1.642578125, 1.7578125, 1.876953125)};
-static_assert(sizeof(tidx) == sizeof(float) * step_size, "");
-static_assert(sizeof(tidx_2) == sizeof(float) * step_size, "");
+// Same as `scalar::linear_phase`.
+template<int S, Precision prec>
+static NACS_INLINE __attribute__((target("sse2")))
+__m128 linear_phase(__m128 tscale, float phase, float freq)
+{
+    if (prec != Precision::High)
+        return phase + tscale * freq;
+    float freq_hi, freq_lo;
+    StepSize<S>::split_freq(freq, freq_hi, freq_lo);
+    auto hi = tscale * freq_hi;
+    hi -= 2 * _mm_cvtepi32_ps(_mm_cvtps_epi32(hi * 0.5f));
+    return (phase + hi) + tscale * freq_lo;
+}
 
 // Phase is in unit of pi
-// Frequency of 1 means one full cycle per 32 samples.
+// Frequency of 1 means one full cycle per step (`S` samples).
+template<int S = step_size, Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("sse2")))
 __m128 calc_single_chn(int i, float _phase, float freq, float _amp,
-                       float dfreq=0, float damp=0)
+                       float dfreq=0, float damp=0, float ddfreq=0, float ddamp=0)
 {
-    assume(0 <= i && i < step_size && i % 4 == 0);
-    auto tscale = tidx[i / 4];
-    auto tscale_2 = tidx_2[i / 4];
-    auto phase = _phase + tscale * freq;
+    assume(0 <= i && i < S && i % 4 == 0);
+    auto tscale = TimeTable<4, S>::tidx[i / 4];
+    auto tscale_2 = TimeTable<4, S>::tidx_2[i / 4];
+    auto phase = linear_phase<S, prec>(tscale, _phase, freq);
     accum_nonzero(phase, tscale_2, dfreq);
+    accum_nonzero(phase, TimeTable<4, S>::tidx_3[i / 4], ddfreq);
     auto amp = _mm_set1_ps(_amp);
     accum_nonzero(amp, tscale, damp);
-    return sinpif_pi(phase) * amp;
+    accum_nonzero(amp, tscale_2, ddamp);
+    return sinpif_pi<prec>(phase) * amp;
+}
+
+static NACS_INLINE __attribute__((target("sse2")))
+void store(float *p, __m128 v)
+{
+    _mm_store_ps(p, v);
+}
+
+// Only the positive side needs to be clamped before the conversion.
+// Out of range values are converted to `0x80000000`, which is saturated to `-32768`
+// by the pack instruction just like any other large negative numbers.
+static NACS_INLINE __attribute__((target("sse2")))
+void store(int16_t *p, __m128 v)
+{
+    auto vi = _mm_cvtps_epi32(_mm_min_ps(v, _mm_set1_ps(32767)));
+    _mm_storel_epi64((__m128i*)p, _mm_packs_epi32(vi, vi));
+}
+
+// Saturated conversion of 8 samples to 16bit integers.
+static NACS_INLINE __attribute__((target("sse2")))
+__m128i cvt_i16(__m128 v0, __m128 v1)
+{
+    auto max = _mm_set1_ps(32767);
+    return _mm_packs_epi32(_mm_cvtps_epi32(_mm_min_ps(v0, max)),
+                           _mm_cvtps_epi32(_mm_min_ps(v1, max)));
+}
+
+// Store 8 samples of each of the `nout` channels interleaved in the order of the card,
+// i.e. sample by sample with the channels of each sample next to each other.
+// Used by all the x86 generators.
+template<int nout>
+static NACS_INLINE __attribute__((target("sse2")))
+void store_interleave(int16_t *p, const __m128i *v)
+{
+    static_assert(nout == 1 || nout == 2 || nout == 4, "");
+    auto pv = (__m128i*)p;
+    if (nout == 1) {
+        _mm_store_si128(pv, v[0]);
+    }
+    else if (nout == 2) {
+        _mm_store_si128(pv, _mm_unpacklo_epi16(v[0], v[1]));
+        _mm_store_si128(pv + 1, _mm_unpackhi_epi16(v[0], v[1]));
+    }
+    else {
+        // Sample 0-3 and 4-7 of channel 0 + 1 and 2 + 3.
+        auto lo01 = _mm_unpacklo_epi16(v[0], v[1]);
+        auto hi01 = _mm_unpackhi_epi16(v[0], v[1]);
+        auto lo23 = _mm_unpacklo_epi16(v[2], v[3]);
+        auto hi23 = _mm_unpackhi_epi16(v[2], v[3]);
+        _mm_store_si128(pv, _mm_unpacklo_epi32(lo01, lo23));
+        _mm_store_si128(pv + 1, _mm_unpackhi_epi32(lo01, lo23));
+        _mm_store_si128(pv + 2, _mm_unpacklo_epi32(hi01, hi23));
+        _mm_store_si128(pv + 3, _mm_unpackhi_epi32(hi01, hi23));
+    }
 }
 
 } // namespace sse2
 
 namespace avx {
 
+template<Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("avx")))
 __m256 sinpif_pi(__m256 d)
 {
+    if (prec == Precision::High)
+        return Sleef_sinpif8_u05avx(d) * float(1 / M_PI);
     __m256i q = _mm256_cvtps_epi32(d);
     d = d - _mm256_cvtepi32_ps(q);
 
@@ -206,51 +471,76 @@ __m256 sinpif_pi(__m256 d)
     neg = _mm256_insertf128_si256(neg, tmp2[1], 1);
     d = __m256((neg & _mm256_set1_epi32(0x80000000)) ^ __m256i(d));
 
+    if (prec == Precision::Low)
+        return (s * d) * (0.74359607f * s - 1.6391299f) + d;
     auto u = -0.17818783f * s + 0.8098674f;
     u = u * s - 1.6448531f;
     return (s * d) * u + d;
 }
 
-static constexpr __m256 tidx[] = {
-    set_ps<__m256>(0.0, 0.0625, 0.125, 0.1875, 0.25, 0.3125, 0.375, 0.4375),
-    set_ps<__m256>(0.5, 0.5625, 0.625, 0.6875, 0.75, 0.8125, 0.875, 0.9375),
-    set_ps<__m256>(1.0, 1.0625, 1.125, 1.1875, 1.25, 1.3125, 1.375, 1.4375),
-    set_ps<__m256>(1.5, 1.5625, 1.625, 1.6875, 1.75, 1.8125, 1.875, 1.9375)};
-static constexpr __m256 tidx_2[] = {
-    set_ps<__m256>(0.0, 0.001953125, 0.0078125, 0.017578125,
-                   0.03125, 0.048828125, 0.0703125, 0.095703125),
-    set_ps<__m256>(0.125, 0.158203125, 0.1953125, 0.236328125,
-                   0.28125, 0.330078125, 0.3828125, 0.439453125),
-    set_ps<__m256>(0.5, 0.564453125, 0.6328125, 0.705078125,
-                   0.78125, 0.861328125, 0.9453125, 1.033203125),
-    set_ps<__m256>(1.125, 1.220703125, 1.3203125, 1.423828125,
-                   1.53125, 1.642578125, 1.7578125, 1.876953125)};
-static_assert(sizeof(tidx) == sizeof(float) * step_size, "");
-static_assert(sizeof(tidx_2) == sizeof(float) * step_size, "");
+// Same as `scalar::linear_phase`.
+template<int S, Precision prec>
+static NACS_INLINE __attribute__((target("avx")))
+__m256 linear_phase(__m256 tscale, float phase, float freq)
+{
+    if (prec != Precision::High)
+        return phase + tscale * freq;
+    float freq_hi, freq_lo;
+    StepSize<S>::split_freq(freq, freq_hi, freq_lo);
+    auto hi = tscale * freq_hi;
+    hi -= 2 * _mm256_round_ps(hi * 0.5f, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return (phase + hi) + tscale * freq_lo;
+}
 
 // Phase is in unit of pi
-// Frequency of 1 means one full cycle per 32 samples.
+// Frequency of 1 means one full cycle per step (`S` samples).
+template<int S = step_size, Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("avx")))
 __m256 calc_single_chn(int i, float _phase, float freq, float _amp,
-                       float dfreq=0, float damp=0)
+                       float dfreq=0, float damp=0, float ddfreq=0, float ddamp=0)
 {
-    assume(0 <= i && i < step_size && i % 8 == 0);
-    auto tscale = tidx[i / 8];
-    auto tscale_2 = tidx_2[i / 8];
-    auto phase = _phase + tscale * freq;
+    assume(0 <= i && i < S && i % 8 == 0);
+    auto tscale = TimeTable<8, S>::tidx[i / 8];
+    auto tscale_2 = TimeTable<8, S>::tidx_2[i / 8];
+    auto phase = linear_phase<S, prec>(tscale, _phase, freq);
     accum_nonzero(phase, tscale_2, dfreq);
+    accum_nonzero(phase, TimeTable<8, S>::tidx_3[i / 8], ddfreq);
     auto amp = _mm256_set1_ps(_amp);
     accum_nonzero(amp, tscale, damp);
-    return sinpif_pi(phase) * amp;
+    accum_nonzero(amp, tscale_2, ddamp);
+    return sinpif_pi<prec>(phase) * amp;
+}
+
+static NACS_INLINE __attribute__((target("avx")))
+void store(float *p, __m256 v)
+{
+    _mm256_store_ps(p, v);
+}
+
+// Saturated conversion to 16bit integers.
+static NACS_INLINE __attribute__((target("avx")))
+__m128i cvt_i16(__m256 v)
+{
+    auto vi = _mm256_cvtps_epi32(_mm256_min_ps(v, _mm256_set1_ps(32767)));
+    return _mm_packs_epi32(_mm256_castsi256_si128(vi), _mm256_extractf128_si256(vi, 1));
+}
+
+static NACS_INLINE __attribute__((target("avx")))
+void store(int16_t *p, __m256 v)
+{
+    _mm_store_si128((__m128i*)p, cvt_i16(v));
 }
 
 } // namespace avx
 
 namespace avx2 {
 
+template<Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("avx2,fma")))
 __m256 sinpif_pi(__m256 d)
 {
+    if (prec == Precision::High)
+        return Sleef_sinpif8_u05avx2(d) * float(1 / M_PI);
     __m256i q = _mm256_cvtps_epi32(d);
     d = d - _mm256_cvtepi32_ps(q);
 
@@ -259,51 +549,183 @@ __m256 sinpif_pi(__m256 d)
     auto neg = _mm256_cmpeq_epi32(q & _mm256_set1_epi32(1), _mm256_set1_epi32(1));
     d = __m256((neg & _mm256_set1_epi32(0x80000000)) ^ __m256i(d));
 
+    if (prec == Precision::Low)
+        return (s * d) * (0.74359607f * s - 1.6391299f) + d;
     auto u = -0.17818783f * s + 0.8098674f;
     u = u * s - 1.6448531f;
     return (s * d) * u + d;
 }
 
-static constexpr __m256 tidx[] = {
-    set_ps<__m256>(0.0, 0.0625, 0.125, 0.1875, 0.25, 0.3125, 0.375, 0.4375),
-    set_ps<__m256>(0.5, 0.5625, 0.625, 0.6875, 0.75, 0.8125, 0.875, 0.9375),
-    set_ps<__m256>(1.0, 1.0625, 1.125, 1.1875, 1.25, 1.3125, 1.375, 1.4375),
-    set_ps<__m256>(1.5, 1.5625, 1.625, 1.6875, 1.75, 1.8125, 1.875, 1.9375)};
-static constexpr __m256 tidx_2[] = {
-    set_ps<__m256>(0.0, 0.001953125, 0.0078125, 0.017578125,
-                   0.03125, 0.048828125, 0.0703125, 0.095703125),
-    set_ps<__m256>(0.125, 0.158203125, 0.1953125, 0.236328125,
-                   0.28125, 0.330078125, 0.3828125, 0.439453125),
-    set_ps<__m256>(0.5, 0.564453125, 0.6328125, 0.705078125,
-                   0.78125, 0.861328125, 0.9453125, 1.033203125),
-    set_ps<__m256>(1.125, 1.220703125, 1.3203125, 1.423828125,
-                   1.53125, 1.642578125, 1.7578125, 1.876953125)};
-static_assert(sizeof(tidx) == sizeof(float) * step_size, "");
-static_assert(sizeof(tidx_2) == sizeof(float) * step_size, "");
+// Same as `scalar::linear_phase`.
+template<int S, Precision prec>
+static NACS_INLINE __attribute__((target("avx2,fma")))
+__m256 linear_phase(__m256 tscale, float phase, float freq)
+{
+    if (prec != Precision::High)
+        return phase + tscale * freq;
+    float freq_hi, freq_lo;
+    StepSize<S>::split_freq(freq, freq_hi, freq_lo);
+    auto hi = tscale * freq_hi;
+    hi -= 2 * _mm256_round_ps(hi * 0.5f, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return (phase + hi) + tscale * freq_lo;
+}
 
 // Phase is in unit of pi
-// Frequency of 1 means one full cycle per 32 samples.
+// Frequency of 1 means one full cycle per step (`S` samples).
+template<int S = step_size, Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("avx2,fma")))
 __m256 calc_single_chn(int i, float _phase, float freq, float _amp,
-                       float dfreq=0, float damp=0)
+                       float dfreq=0, float damp=0, float ddfreq=0, float ddamp=0)
 {
-    assume(0 <= i && i < step_size && i % 8 == 0);
-    auto tscale = tidx[i / 8];
-    auto tscale_2 = tidx_2[i / 8];
-    auto phase = _phase + tscale * freq;
+    assume(0 <= i && i < S && i % 8 == 0);
+    auto tscale = TimeTable<8, S>::tidx[i / 8];
+    auto tscale_2 = TimeTable<8, S>::tidx_2[i / 8];
+    auto phase = linear_phase<S, prec>(tscale, _phase, freq);
     accum_nonzero(phase, tscale_2, dfreq);
+    accum_nonzero(phase, TimeTable<8, S>::tidx_3[i / 8], ddfreq);
     auto amp = _mm256_set1_ps(_amp);
     accum_nonzero(amp, tscale, damp);
-    return sinpif_pi(phase) * amp;
+    accum_nonzero(amp, tscale_2, ddamp);
+    return sinpif_pi<prec>(phase) * amp;
+}
+
+static NACS_INLINE __attribute__((target("avx2,fma")))
+void store(float *p, __m256 v)
+{
+    _mm256_store_ps(p, v);
+}
+
+// Saturated conversion to 16bit integers.
+static NACS_INLINE __attribute__((target("avx2,fma")))
+__m128i cvt_i16(__m256 v)
+{
+    auto vi = _mm256_cvtps_epi32(_mm256_min_ps(v, _mm256_set1_ps(32767)));
+    return _mm_packs_epi32(_mm256_castsi256_si128(vi), _mm256_extractf128_si256(vi, 1));
+}
+
+static NACS_INLINE __attribute__((target("avx2,fma")))
+void store(int16_t *p, __m256 v)
+{
+    _mm_store_si128((__m128i*)p, cvt_i16(v));
+}
+
+static NACS_INLINE __attribute__((target("avx2,fma")))
+float hsum(__m256 v)
+{
+    auto v4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    v4 = _mm_add_ps(v4, _mm_movehl_ps(v4, v4));
+    v4 = _mm_add_ss(v4, _mm_shuffle_ps(v4, v4, 1));
+    return _mm_cvtss_f32(v4);
+}
+
+// `sin(pi * x / 32768)` in Q15.
+static NACS_INLINE __attribute__((target("avx2,fma")))
+__m256i sinpi_q15(__m256i x)
+{
+    // Reflect `x` into `[-16384, 16384]`, i.e. `x -> sign(x) * 32768 - x` for `|x| > 16384`.
+    // (`abs(-32768)` wraps around to the correct result).
+    auto y = _mm256_sub_epi16(_mm256_abs_epi16(_mm256_add_epi16(x, _mm256_set1_epi16(16384))),
+                              _mm256_set1_epi16(16384));
+    // The phase in unit of `pi / 2` in Q15.
+    // The lower end is clamped to avoid the overflow in `mulhrs(-1, -1)`.
+    auto w = _mm256_max_epi16(_mm256_adds_epi16(y, y), _mm256_set1_epi16(-32767));
+    auto w2 = _mm256_mulhrs_epi16(w, w);
+    auto p = _mm256_add_epi16(_mm256_mulhrs_epi16(_mm256_set1_epi16(q15::sin_c7), w2),
+                              _mm256_set1_epi16(q15::sin_c5));
+    p = _mm256_add_epi16(_mm256_mulhrs_epi16(p, w2), _mm256_set1_epi16(q15::sin_c3));
+    p = _mm256_add_epi16(_mm256_mulhrs_epi16(p, w2), _mm256_set1_epi16(q15::sin_c1));
+    return _mm256_adds_epi16(_mm256_mulhrs_epi16(w, p), w);
+}
+
+// The top 16 bits of the even and odd samples in sample order.
+static NACS_INLINE __attribute__((target("avx2,fma")))
+__m256i hi16(__m256i even, __m256i odd)
+{
+    return _mm256_blend_epi16(_mm256_srli_epi32(even, 16), odd, 0xaa);
+}
+
+// Add a tone to the `S / 16` vectors of 16 samples in `acc`.
+// The 32bit phase and amplitude are computed separately for the even and odd samples
+// and advanced by 16 samples at a time with only additions.
+template<int S, bool ramp>
+static NACS_INLINE __attribute__((target("avx2,fma")))
+void add_tone_q15(__m256i *acc, const q15::Tone &t)
+{
+    static_assert(S % 16 == 0, "");
+    const auto ie = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    auto freq = _mm256_set1_epi32(int(t.freq));
+    __m256i phase_e;
+    __m256i phase_o;
+    __m256i dphase_e;
+    __m256i dphase_o;
+    __m256i ddphase;
+    __m256i amp_e;
+    __m256i amp_o;
+    __m256i damp;
+    __m256i amp16;
+    if (ramp) {
+        // `phase(j) = phase + j * freq + j^2 * dfreq`
+        auto dfreq = _mm256_set1_epi32(int(t.dfreq));
+        auto jd = _mm256_mullo_epi32(ie, dfreq);
+        phase_e = _mm256_add_epi32(_mm256_set1_epi32(int(t.phase)),
+                                   _mm256_mullo_epi32(ie, _mm256_add_epi32(freq, jd)));
+        phase_o = _mm256_add_epi32(_mm256_add_epi32(phase_e, _mm256_add_epi32(freq, dfreq)),
+                                   _mm256_slli_epi32(jd, 1));
+        dphase_e = _mm256_add_epi32(_mm256_set1_epi32(int(t.freq * 16 + t.dfreq * 256)),
+                                    _mm256_slli_epi32(jd, 5));
+        dphase_o = _mm256_add_epi32(dphase_e, _mm256_set1_epi32(int(t.dfreq * 32)));
+        ddphase = _mm256_set1_epi32(int(t.dfreq * 512));
+        amp_e = _mm256_add_epi32(_mm256_set1_epi32(t.amp),
+                                 _mm256_mullo_epi32(ie, _mm256_set1_epi32(t.damp)));
+        amp_o = _mm256_add_epi32(amp_e, _mm256_set1_epi32(t.damp));
+        damp = _mm256_set1_epi32(t.damp * 16);
+    }
+    else {
+        phase_e = _mm256_add_epi32(_mm256_set1_epi32(int(t.phase)),
+                                   _mm256_mullo_epi32(ie, freq));
+        phase_o = _mm256_add_epi32(phase_e, freq);
+        dphase_e = dphase_o = _mm256_set1_epi32(int(t.freq * 16));
+        amp16 = _mm256_set1_epi16(int16_t(t.amp >> 16));
+    }
+    for (int k = 0; k < S / 16; k++) {
+        auto v = sinpi_q15(hi16(phase_e, phase_o));
+        auto amp = ramp ? hi16(amp_e, amp_o) : amp16;
+        acc[k] = _mm256_adds_epi16(acc[k], _mm256_mulhrs_epi16(v, amp));
+        phase_e = _mm256_add_epi32(phase_e, dphase_e);
+        phase_o = _mm256_add_epi32(phase_o, dphase_o);
+        if (ramp) {
+            dphase_e = _mm256_add_epi32(dphase_e, ddphase);
+            dphase_o = _mm256_add_epi32(dphase_o, ddphase);
+            amp_e = _mm256_add_epi32(amp_e, damp);
+            amp_o = _mm256_add_epi32(amp_o, damp);
+        }
+    }
+}
+
+static NACS_INLINE __attribute__((target("avx2,fma")))
+void store_q15(int16_t *p, __m256i v)
+{
+    _mm256_store_si256((__m256i*)p, v);
+}
+
+static NACS_INLINE __attribute__((target("avx2,fma")))
+void store_q15(float *p, __m256i v)
+{
+    _mm256_store_ps(p, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v))));
+    _mm256_store_ps(p + 8, _mm256_cvtepi32_ps(
+                        _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1))));
 }
 
 } // namespace avx2
 
 namespace avx512 {
 
+template<Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("avx512f,avx512dq")))
 __m512 sinpif_pi(__m512 d)
 {
+    if (prec == Precision::High)
+        return Sleef_sinpif16_u05avx512f(d) * float(1 / M_PI);
     __m512i q = _mm512_cvtps_epi32(d);
     d = d - _mm512_cvtepi32_ps(q);
 
@@ -313,45 +735,2339 @@ __m512 sinpif_pi(__m512 d)
     d = (__m512)_mm512_mask_xor_epi32((__m512i)d, neg, (__m512i)d,
                                       _mm512_set1_epi32(0x80000000));
 
+    if (prec == Precision::Low)
+        return (s * d) * (0.74359607f * s - 1.6391299f) + d;
     auto u = -0.17818783f * s + 0.8098674f;
     u = u * s - 1.6448531f;
     return (s * d) * u + d;
 }
 
-static constexpr __m512 tidx[] = {
-    set_ps<__m512>(0.0, 0.0625, 0.125, 0.1875, 0.25, 0.3125, 0.375, 0.4375,
-                   0.5, 0.5625, 0.625, 0.6875, 0.75, 0.8125, 0.875, 0.9375),
-    set_ps<__m512>(1.0, 1.0625, 1.125, 1.1875, 1.25, 1.3125, 1.375, 1.4375,
-                   1.5, 1.5625, 1.625, 1.6875, 1.75, 1.8125, 1.875, 1.9375)};
-static constexpr __m512 tidx_2[] = {
-    set_ps<__m512>(0.0, 0.001953125, 0.0078125, 0.017578125,
-                   0.03125, 0.048828125, 0.0703125, 0.095703125,
-                   0.125, 0.158203125, 0.1953125, 0.236328125,
-                   0.28125, 0.330078125, 0.3828125, 0.439453125),
-    set_ps<__m512>(0.5, 0.564453125, 0.6328125, 0.705078125,
-                   0.78125, 0.861328125, 0.9453125, 1.033203125,
-                   1.125, 1.220703125, 1.3203125, 1.423828125,
-                   1.53125, 1.642578125, 1.7578125, 1.876953125)};
-static_assert(sizeof(tidx) == sizeof(float) * step_size, "");
-static_assert(sizeof(tidx_2) == sizeof(float) * step_size, "");
+// Same as `scalar::linear_phase`.
+template<int S, Precision prec>
+static NACS_INLINE __attribute__((target("avx512f,avx512dq")))
+__m512 linear_phase(__m512 tscale, float phase, float freq)
+{
+    if (prec != Precision::High)
+        return phase + tscale * freq;
+    float freq_hi, freq_lo;
+    StepSize<S>::split_freq(freq, freq_hi, freq_lo);
+    auto hi = tscale * freq_hi;
+    hi -= 2 * _mm512_roundscale_ps(hi * 0.5f,
+                                   _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    return (phase + hi) + tscale * freq_lo;
+}
 
 // Phase is in unit of pi
-// Frequency of 1 means one full cycle per 32 samples.
+// Frequency of 1 means one full cycle per step (`S` samples).
+template<int S = step_size, Precision prec = Precision::Default>
 static NACS_INLINE __attribute__((target("avx512f,avx512dq")))
 __m512 calc_single_chn(int i, float _phase, float freq, float _amp,
-                       float dfreq=0, float damp=0)
+                       float dfreq=0, float damp=0, float ddfreq=0, float ddamp=0)
 {
-    assume(0 <= i && i < step_size && i % 16 == 0);
-    auto tscale = tidx[i / 16];
-    auto tscale_2 = tidx_2[i / 16];
-    auto phase = _phase + tscale * freq;
+    assume(0 <= i && i < S && i % 16 == 0);
+    auto tscale = TimeTable<16, S>::tidx[i / 16];
+    auto tscale_2 = TimeTable<16, S>::tidx_2[i / 16];
+    auto phase = linear_phase<S, prec>(tscale, _phase, freq);
     accum_nonzero(phase, tscale_2, dfreq);
+    accum_nonzero(phase, TimeTable<16, S>::tidx_3[i / 16], ddfreq);
     auto amp = _mm512_set1_ps(_amp);
     accum_nonzero(amp, tscale, damp);
-    return sinpif_pi(phase) * amp;
+    accum_nonzero(amp, tscale_2, ddamp);
+    return sinpif_pi<prec>(phase) * amp;
+}
+
+static NACS_INLINE __attribute__((target("avx512f,avx512dq")))
+void store(float *p, __m512 v)
+{
+    _mm512_store_ps(p, v);
+}
+
+// Saturated conversion to 16bit integers.
+static NACS_INLINE __attribute__((target("avx512f,avx512dq")))
+__m256i cvt_i16(__m512 v)
+{
+    auto vi = _mm512_cvtps_epi32(_mm512_min_ps(v, _mm512_set1_ps(32767)));
+    return _mm512_cvtsepi32_epi16(vi);
+}
+
+static NACS_INLINE __attribute__((target("avx512f,avx512dq")))
+void store(int16_t *p, __m512 v)
+{
+    _mm256_store_si256((__m256i*)p, cvt_i16(v));
+}
+
+// Same as `avx2::sinpi_q15`.
+static NACS_INLINE __attribute__((target("avx512f,avx512dq,avx512bw")))
+__m512i sinpi_q15(__m512i x)
+{
+    auto y = _mm512_sub_epi16(_mm512_abs_epi16(_mm512_add_epi16(x, _mm512_set1_epi16(16384))),
+                              _mm512_set1_epi16(16384));
+    auto w = _mm512_max_epi16(_mm512_adds_epi16(y, y), _mm512_set1_epi16(-32767));
+    auto w2 = _mm512_mulhrs_epi16(w, w);
+    auto p = _mm512_add_epi16(_mm512_mulhrs_epi16(_mm512_set1_epi16(q15::sin_c7), w2),
+                              _mm512_set1_epi16(q15::sin_c5));
+    p = _mm512_add_epi16(_mm512_mulhrs_epi16(p, w2), _mm512_set1_epi16(q15::sin_c3));
+    p = _mm512_add_epi16(_mm512_mulhrs_epi16(p, w2), _mm512_set1_epi16(q15::sin_c1));
+    return _mm512_adds_epi16(_mm512_mulhrs_epi16(w, p), w);
+}
+
+static NACS_INLINE __attribute__((target("avx512f,avx512dq,avx512bw")))
+__m512i hi16(__m512i even, __m512i odd)
+{
+    return _mm512_mask_blend_epi16(0xaaaaaaaa, _mm512_srli_epi32(even, 16), odd);
+}
+
+// Same as `avx2::add_tone_q15` with 32 samples per vector.
+template<int S, bool ramp>
+static NACS_INLINE __attribute__((target("avx512f,avx512dq,avx512bw")))
+void add_tone_q15(__m512i *acc, const q15::Tone &t)
+{
+    static_assert(S % 32 == 0, "");
+    const auto ie = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14,
+                                      16, 18, 20, 22, 24, 26, 28, 30);
+    auto freq = _mm512_set1_epi32(int(t.freq));
+    __m512i phase_e;
+    __m512i phase_o;
+    __m512i dphase_e;
+    __m512i dphase_o;
+    __m512i ddphase;
+    __m512i amp_e;
+    __m512i amp_o;
+    __m512i damp;
+    __m512i amp16;
+    if (ramp) {
+        auto dfreq = _mm512_set1_epi32(int(t.dfreq));
+        auto jd = _mm512_mullo_epi32(ie, dfreq);
+        phase_e = _mm512_add_epi32(_mm512_set1_epi32(int(t.phase)),
+                                   _mm512_mullo_epi32(ie, _mm512_add_epi32(freq, jd)));
+        phase_o = _mm512_add_epi32(_mm512_add_epi32(phase_e, _mm512_add_epi32(freq, dfreq)),
+                                   _mm512_slli_epi32(jd, 1));
+        dphase_e = _mm512_add_epi32(_mm512_set1_epi32(int(t.freq * 32 + t.dfreq * 1024)),
+                                    _mm512_slli_epi32(jd, 6));
+        dphase_o = _mm512_add_epi32(dphase_e, _mm512_set1_epi32(int(t.dfreq * 64)));
+        ddphase = _mm512_set1_epi32(int(t.dfreq * 2048));
+        amp_e = _mm512_add_epi32(_mm512_set1_epi32(t.amp),
+                                 _mm512_mullo_epi32(ie, _mm512_set1_epi32(t.damp)));
+        amp_o = _mm512_add_epi32(amp_e, _mm512_set1_epi32(t.damp));
+        damp = _mm512_set1_epi32(t.damp * 32);
+    }
+    else {
+        phase_e = _mm512_add_epi32(_mm512_set1_epi32(int(t.phase)),
+                                   _mm512_mullo_epi32(ie, freq));
+        phase_o = _mm512_add_epi32(phase_e, freq);
+        dphase_e = dphase_o = _mm512_set1_epi32(int(t.freq * 32));
+        amp16 = _mm512_set1_epi16(int16_t(t.amp >> 16));
+    }
+    for (int k = 0; k < S / 32; k++) {
+        auto v = sinpi_q15(hi16(phase_e, phase_o));
+        auto amp = ramp ? hi16(amp_e, amp_o) : amp16;
+        acc[k] = _mm512_adds_epi16(acc[k], _mm512_mulhrs_epi16(v, amp));
+        phase_e = _mm512_add_epi32(phase_e, dphase_e);
+        phase_o = _mm512_add_epi32(phase_o, dphase_o);
+        if (ramp) {
+            dphase_e = _mm512_add_epi32(dphase_e, ddphase);
+            dphase_o = _mm512_add_epi32(dphase_o, ddphase);
+            amp_e = _mm512_add_epi32(amp_e, damp);
+            amp_o = _mm512_add_epi32(amp_o, damp);
+        }
+    }
+}
+
+// The `h`th group of 8 samples. `h` must be known at compile time.
+static NACS_INLINE __attribute__((target("avx512f,avx512dq,avx512bw")))
+__m128i extract128(__m512i v, int h)
+{
+    switch (h) {
+    case 0:
+        return _mm512_castsi512_si128(v);
+    case 1:
+        return _mm512_extracti32x4_epi32(v, 1);
+    case 2:
+        return _mm512_extracti32x4_epi32(v, 2);
+    default:
+        return _mm512_extracti32x4_epi32(v, 3);
+    }
+}
+
+static NACS_INLINE __attribute__((target("avx512f,avx512dq,avx512bw")))
+void store_q15(int16_t *p, __m512i v)
+{
+    _mm512_store_si512(p, v);
+}
+
+static NACS_INLINE __attribute__((target("avx512f,avx512dq,avx512bw")))
+void store_q15(float *p, __m512i v)
+{
+    _mm512_store_ps(p, _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(
+                                              _mm512_castsi512_si256(v))));
+    _mm512_store_ps(p + 16, _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(
+                                                   _mm512_extracti64x4_epi64(v, 1))));
 }
 
 } // namespace avx512
+#elif NACS_CPU_AARCH64
+
+namespace neon {
+
+// Same as `sse2::sinpif_pi` with the rounding done by the conversion instruction.
+template<Precision prec = Precision::Default>
+static NACS_INLINE float32x4_t sinpif_pi(float32x4_t d)
+{
+    if (prec == Precision::High)
+        return vmulq_n_f32(Sleef_sinpif4_u05advsimd(d), float(1 / M_PI));
+    int32x4_t q = vcvtnq_s32_f32(d);
+    d = vsubq_f32(d, vcvtq_f32_s32(q));
+
+    float32x4_t s = vmulq_f32(d, d);
+
+    // Move the lowest bit of `q` to the sign bit.
+    auto neg = vshlq_n_u32(vreinterpretq_u32_s32(q), 31);
+    d = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(d), neg));
+
+    if (prec == Precision::Low) {
+        auto u = vfmaq_n_f32(vdupq_n_f32(-1.6391299f), s, 0.74359607f);
+        return vfmaq_f32(d, vmulq_f32(s, d), u);
+    }
+    auto u = vfmaq_n_f32(vdupq_n_f32(0.8098674f), s, -0.17818783f);
+    u = vfmaq_f32(vdupq_n_f32(-1.6448531f), u, s);
+    return vfmaq_f32(d, vmulq_f32(s, d), u);
+}
+
+// Same as `scalar::linear_phase`.
+template<int S, Precision prec>
+static NACS_INLINE float32x4_t linear_phase(float32x4_t tscale, float phase, float freq)
+{
+    if (prec != Precision::High)
+        return vfmaq_n_f32(vdupq_n_f32(phase), tscale, freq);
+    float freq_hi, freq_lo;
+    StepSize<S>::split_freq(freq, freq_hi, freq_lo);
+    auto hi = vmulq_n_f32(tscale, freq_hi);
+    hi = vfmsq_n_f32(hi, vrndnq_f32(vmulq_n_f32(hi, 0.5f)), 2);
+    return vfmaq_n_f32(vaddq_f32(vdupq_n_f32(phase), hi), tscale, freq_lo);
+}
+
+// Phase is in unit of pi
+// Frequency of 1 means one full cycle per step (`S` samples).
+template<int S = step_size, Precision prec = Precision::Default>
+static NACS_INLINE float32x4_t calc_single_chn(int i, float _phase, float freq, float _amp,
+                                               float dfreq=0, float damp=0,
+                                               float ddfreq=0, float ddamp=0)
+{
+    assume(0 <= i && i < S && i % 4 == 0);
+    auto tscale = (float32x4_t)TimeTable<4, S>::tidx[i / 4];
+    auto tscale_2 = (float32x4_t)TimeTable<4, S>::tidx_2[i / 4];
+    auto phase = linear_phase<S, prec>(tscale, _phase, freq);
+    accum_nonzero(phase, tscale_2, dfreq);
+    accum_nonzero(phase, (float32x4_t)TimeTable<4, S>::tidx_3[i / 4], ddfreq);
+    auto amp = vdupq_n_f32(_amp);
+    accum_nonzero(amp, tscale, damp);
+    accum_nonzero(amp, tscale_2, ddamp);
+    return vmulq_f32(sinpif_pi<prec>(phase), amp);
+}
+
+static NACS_INLINE void store(float *p, float32x4_t v)
+{
+    vst1q_f32(p, v);
+}
+
+// The conversion to integer saturates on ARM
+// so the value doesn't need to be clamped first.
+static NACS_INLINE int16x4_t cvt_i16(float32x4_t v)
+{
+    return vqmovn_s32(vcvtnq_s32_f32(v));
+}
+
+static NACS_INLINE void store(int16_t *p, float32x4_t v)
+{
+    vst1_s16(p, cvt_i16(v));
+}
+
+// Store 4 samples of each of the `nout` channels interleaved in the order of the card.
+// The structure stores do the interleaving for us.
+template<int nout>
+static NACS_INLINE void store_interleave(int16_t *p, const int16x4_t *v)
+{
+    static_assert(nout == 1 || nout == 2 || nout == 4, "");
+    if (nout == 1) {
+        vst1_s16(p, v[0]);
+    }
+    else if (nout == 2) {
+        vst2_s16(p, (int16x4x2_t{{v[0], v[1]}}));
+    }
+    else {
+        vst4_s16(p, (int16x4x4_t{{v[0], v[1], v[2], v[3]}}));
+    }
+}
+
+} // namespace neon
+
+#ifdef NACS_SPCM_SVE
+// The SVE vectors don't have a fixed length so each step is processed
+// `svcntw()` samples at a time with the tail masked off by the predicate.
+// These types also don't support the generic vector operations
+// so everything is done with the intrinsics.
+namespace sve {
+
+template<Precision prec = Precision::Default>
+static NACS_INLINE __attribute__((target("+sve")))
+svfloat32_t sinpif_pi(svbool_t pg, svfloat32_t d)
+{
+    if (prec == Precision::High)
+        return svmul_n_f32_x(pg, Sleef_sinpifx_u05sve(d), float(1 / M_PI));
+    auto r = svrintn_f32_x(pg, d);
+    auto q = svcvt_s32_f32_x(pg, r);
+    d = svsub_f32_x(pg, d, r);
+
+    auto s = svmul_f32_x(pg, d, d);
+
+    auto neg = svlsl_n_u32_x(pg, svreinterpret_u32_s32(q), 31);
+    d = svreinterpret_f32_u32(sveor_u32_x(pg, svreinterpret_u32_f32(d), neg));
+
+    if (prec == Precision::Low) {
+        auto u = svmad_n_f32_x(pg, s, svdup_n_f32(0.74359607f), -1.6391299f);
+        return svmla_f32_x(pg, d, svmul_f32_x(pg, s, d), u);
+    }
+    auto u = svmad_n_f32_x(pg, s, svdup_n_f32(-0.17818783f), 0.8098674f);
+    u = svmad_n_f32_x(pg, u, s, -1.6448531f);
+    return svmla_f32_x(pg, d, svmul_f32_x(pg, s, d), u);
+}
+
+static NACS_INLINE __attribute__((target("+sve")))
+void accum_nonzero(svbool_t pg, svfloat32_t &out, svfloat32_t in, float s)
+{
+    if (__builtin_constant_p(s) && s == 0)
+        return;
+    out = svmla_n_f32_x(pg, out, in, s);
+}
+
+// `StepSize<S>::tidx` and `StepSize<S>::tidx_2` for the samples starting at `i`.
+template<int S = step_size>
+static NACS_INLINE __attribute__((target("+sve")))
+void time_scale(svbool_t pg, int i, svfloat32_t &tscale, svfloat32_t &tscale_2)
+{
+    auto idx = svcvt_f32_s32_x(pg, svindex_s32(i, 1));
+    tscale = svmul_n_f32_x(pg, idx, 2.0f / S);
+    tscale_2 = svmul_n_f32_x(pg, svmul_f32_x(pg, idx, idx), 2.0f / (S * S));
+}
+
+// Same as `scalar::linear_phase`.
+template<int S, Precision prec>
+static NACS_INLINE __attribute__((target("+sve")))
+svfloat32_t linear_phase(svbool_t pg, svfloat32_t tscale, float phase, float freq)
+{
+    if (prec != Precision::High)
+        return svmla_n_f32_x(pg, svdup_n_f32(phase), tscale, freq);
+    float freq_hi, freq_lo;
+    StepSize<S>::split_freq(freq, freq_hi, freq_lo);
+    auto hi = svmul_n_f32_x(pg, tscale, freq_hi);
+    hi = svmls_n_f32_x(pg, hi, svrintn_f32_x(pg, svmul_n_f32_x(pg, hi, 0.5f)), 2);
+    return svmla_n_f32_x(pg, svadd_n_f32_x(pg, hi, phase), tscale, freq_lo);
+}
+
+// Phase is in unit of pi
+// Frequency of 1 means one full cycle per step (`S` samples).
+// The cubic term (`StepSize<S>::tidx_3`) is `tscale * tscale_2 / 2`,
+// which is exact and only computed when `ddfreq` is used.
+template<int S = step_size, Precision prec = Precision::Default>
+static NACS_INLINE __attribute__((target("+sve")))
+svfloat32_t calc_single_chn(svbool_t pg, svfloat32_t tscale, svfloat32_t tscale_2,
+                            float _phase, float freq, float _amp,
+                            float dfreq=0, float damp=0, float ddfreq=0, float ddamp=0)
+{
+    auto phase = linear_phase<S, prec>(pg, tscale, _phase, freq);
+    accum_nonzero(pg, phase, tscale_2, dfreq);
+    if (!(__builtin_constant_p(ddfreq) && ddfreq == 0)) {
+        auto tscale_3 = svmul_n_f32_x(pg, svmul_f32_x(pg, tscale, tscale_2), 0.5f);
+        accum_nonzero(pg, phase, tscale_3, ddfreq);
+    }
+    auto amp = svdup_n_f32(_amp);
+    accum_nonzero(pg, amp, tscale, damp);
+    accum_nonzero(pg, amp, tscale_2, ddamp);
+    return svmul_f32_x(pg, sinpif_pi<prec>(pg, phase), amp);
+}
+
+static NACS_INLINE __attribute__((target("+sve")))
+void store(svbool_t pg, float *p, svfloat32_t v)
+{
+    svst1_f32(pg, p, v);
+}
+
+// Rounded to the nearest like the x86 conversion
+// and clamped first since the narrowing store truncates.
+static NACS_INLINE __attribute__((target("+sve")))
+svint32_t cvt_i32(svbool_t pg, svfloat32_t v)
+{
+    v = svmin_n_f32_x(pg, svmax_n_f32_x(pg, v, -32768), 32767);
+    return svcvt_s32_f32_x(pg, svrintn_f32_x(pg, v));
+}
+
+static NACS_INLINE __attribute__((target("+sve")))
+void store(svbool_t pg, int16_t *p, svfloat32_t v)
+{
+    svst1h_s32(pg, p, cvt_i32(pg, v));
+}
+
+// Store the samples of output channel `o` out of `nout` interleaved channels.
+static NACS_INLINE __attribute__((target("+sve")))
+void store_interleave(svbool_t pg, int16_t *p, int o, int nout, svfloat32_t v)
+{
+    if (nout == 1) {
+        store(pg, p, v);
+        return;
+    }
+    svst1h_scatter_s32index_s32(pg, p, svindex_s32(o, nout), cvt_i32(pg, v));
+}
+
+} // namespace sve
+#endif
+
+#endif
+
+// The generators below compute one step (`step_size` samples) of the summed
+// output of `nchns` channels. They are used both by `DataStream` and the tests/benchmarks.
+#define OUT_ATTR __restrict__ __attribute__((aligned(64)))
+#define PARAM_ATTR __restrict__
+
+struct channel_param_fixed {
+    float phase;
+    float freq;
+    float amp;
+};
+
+struct channel_param {
+    const float *phase;
+    const float *freq;
+    const float *dfreq;
+    const float *amp;
+    const float *damp;
+};
+
+// All the parameters of a tone for a step in a single record
+// so that they are loaded from a single cache line.
+// The records for consecutive steps are stored one after another, i.e. the parameters
+// of tone `c` for step `s` are at index `s * nchns + c`.
+struct alignas(32) channel_param_packed {
+    float phase;
+    float freq;
+    float dfreq;
+    float amp;
+    float damp;
+};
+
+// Same as `channel_param_packed` with the cubic phase term (`ddfreq`, i.e. a linear ramp
+// of `dfreq`) and the quadratic amplitude term (`ddamp`) added.
+// Still fits in the same 32 bytes but it's a separate type so that the generators
+// only compute the higher order terms for the steps that use them.
+struct alignas(32) channel_param_ramp2 {
+    float phase;
+    float freq;
+    float dfreq;
+    float ddfreq;
+    float amp;
+    float damp;
+    float ddamp;
+};
+
+// The tones of an output channel sorted by the ramps they use so that each group
+// is computed by a loop with only the terms it needs (the `sum_chns` of the generators)
+// and the constant tones cost as much as they do with `channel_param_fixed`.
+// `params[0:nfixed]` don't ramp, `params[nfixed:nfreq]` only ramp the frequency,
+// `params[nfreq:namp]` only ramp the amplitude and the rest ramp both.
+struct channel_param_groups {
+    const channel_param_packed *params;
+    int nfixed;
+    int nfreq;
+    int namp;
+};
+
+// Prevent the compiler from assuming that the memory pointed to by `p`
+// is unchanged across steps so that the parameters are reloaded for each step
+// like what happens when they are updated between steps.
+static NACS_INLINE void leak_data(const void *p)
+{
+    asm volatile ("" :: "r"(p): "memory");
+}
+
+// A tone count known at compile time, for the kernels specialized for small tone counts.
+// It converts to the count where only the number is needed and the `sum_chns`
+// of the generators take it as an index sequence to fully unroll the loop over the tones.
+template<int N>
+struct ntones_t : std::make_integer_sequence<int, N> {
+    constexpr operator int() const
+    {
+        return N;
+    }
+};
+
+// Used in place of the array of the tone counts (`nchns`) when all the output channels
+// have `N` tones.
+template<int N>
+struct nchns_t {
+    constexpr ntones_t<N> operator[](int) const
+    {
+        return {};
+    }
+};
+
+template<typename Gen, int S, typename T>
+static NACS_INLINE void _run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                                        const channel_param_fixed *params_fixed)
+{
+    // Note that this implementation does not forward the phase so it does not
+    // compute a continuous sine wave.
+    // However, this better represents the actual calculation.
+    // The long term phase (which is converted to the initial phase) tracked with
+    // an integer so we'll not have any large phase accumulation on floating point
+    // numbers.
+    assume(rep > 0);
+    assume(sz > 0);
+    for (size_t r = 0; r < rep; r++) {
+        for (size_t offset = 0; offset < sz; offset += S) {
+            leak_data(&nchn);
+            leak_data(params_fixed);
+            Gen::template calc_wave_fixed<S>(&data[offset], nchn, params_fixed);
+        }
+    }
+}
+
+template<typename Gen, int S, typename T>
+static NACS_INLINE void _run_wave(T *data, size_t sz, size_t rep, int nchn,
+                                  const channel_param *params)
+{
+    assume(rep > 0);
+    assume(sz > 0);
+    for (size_t r = 0; r < rep; r++) {
+        for (size_t offset = 0; offset < sz; offset += S) {
+            leak_data(&nchn);
+            leak_data(params);
+            Gen::template calc_wave<S>(&data[offset], nchn, params, offset / S);
+        }
+    }
+}
+
+template<typename Gen, int S, typename T>
+static NACS_INLINE void _run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                                         const channel_param_packed *params)
+{
+    assume(rep > 0);
+    assume(sz > 0);
+    for (size_t r = 0; r < rep; r++) {
+        for (size_t offset = 0; offset < sz; offset += S) {
+            leak_data(&nchn);
+            leak_data(params);
+            Gen::template calc_wave_packed<S>(&data[offset], nchn,
+                                               &params[offset / S * nchn]);
+        }
+    }
+}
+
+static NACS_INLINE const channel_param_fixed*
+step_params(const channel_param_fixed *params, size_t, int)
+{
+    return params;
+}
+
+static NACS_INLINE const channel_param_packed*
+step_params(const channel_param_packed *params, size_t step, int nchn)
+{
+    return &params[step * nchn];
+}
+
+static NACS_INLINE const channel_param_ramp2*
+step_params(const channel_param_ramp2 *params, size_t step, int nchn)
+{
+    return &params[step * nchn];
+}
+
+// Only used for a single step.
+static NACS_INLINE const channel_param_groups*
+step_params(const channel_param_groups *params, size_t, int)
+{
+    return params;
+}
+
+// Generate `nout` output channels interleaved sample by sample as the card expects.
+// The tones of output channel `o` are `params[o][0:nchns[o]]`,
+// which can be empty.
+template<typename Gen, int nout, int S, typename P>
+static NACS_INLINE void _run_wave_multi(int16_t *data, size_t sz, size_t rep,
+                                        const int *nchns, const P *const *params)
+{
+    assume(rep > 0);
+    assume(sz > 0);
+    for (size_t r = 0; r < rep; r++) {
+        for (size_t offset = 0; offset < sz; offset += S) {
+            leak_data(nchns);
+            leak_data(params);
+            const P *ps[nout];
+            for (int o = 0; o < nout; o++)
+                ps[o] = step_params(params[o], offset / S, nchns[o]);
+            Gen::template calc_wave_multi<nout, S>(&data[offset * nout], nchns, ps);
+        }
+    }
+}
+
+// Generate `nsteps` consecutive steps of constant tones with a single call
+// instead of one call for each step (`_run_wave_multi`) so that the dispatch
+// and the setup of each step are amortized over the whole batch.
+// Only the phases change between the steps. They are computed from the phase
+// at the start (`phase`) and the change per step (`dphase`) of each tone
+// as 32bit fixed point numbers (`2^32` being a full cycle), which wrap around exactly
+// so that the phase doesn't drift within the batch.
+// `params[o]` provides the frequencies and amplitudes of output channel `o`
+// and its phases are overwritten for each step.
+// `nchns` is either an array or a `nchns_t` for a tone count known at compile time.
+template<typename Gen, int nout, int S, typename NC>
+static NACS_INLINE void _run_wave_steps(int16_t *data, size_t nsteps, NC nchns,
+                                        channel_param_fixed *const *params,
+                                        const uint32_t *const *phase,
+                                        const uint32_t *const *dphase)
+{
+    assume(nsteps > 0);
+    const channel_param_fixed *ps[nout];
+    for (int o = 0; o < nout; o++)
+        ps[o] = params[o];
+    for (size_t s = 0; s < nsteps; s++) {
+        for (int o = 0; o < nout; o++) {
+            auto p = params[o];
+            auto ph = phase[o];
+            auto dph = dphase[o];
+            for (int k = 0; k < nchns[o]; k++) {
+                p[k].phase = float(int32_t(ph[k] + uint32_t(s) * dph[k])) * 0x1p-31f;
+            }
+        }
+        Gen::template calc_wave_multi<nout, S>(&data[s * S * nout], nchns, ps);
+    }
+}
+
+// The generators for non-default implementations implement this class
+// to add the correct target attribute so that the inlining is allowed.
+// However, since the implementation of the loop (`_run_wave` and `_run_wave_fixed`)
+// shared by all implementation cannot have target attribute,
+// the `cal_wave` and `cal_wave_fixed` still cannot be `always_inline` or
+// the compiler will complain about not able to inline even though the function
+// that got inlined into is always inlined into a function that has the correct
+// target attribute and therefore can be inlined into.
+// What does work, then, is to mark the runner as `flatten`,
+// which is allowed to inline multiple layers of functions despite more generic target
+// in the middle level.
+template<typename Gen>
+struct Runner {
+    template<int S = step_size, typename T>
+    static void __attribute__((flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<Gen, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<Gen, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<Gen, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<Gen, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<Gen, nout, S>(data, nsteps, nchns, params, phase, dphase);
+    }
+    // Single output channel with `N` tones (`nchns[0] == N`).
+    template<int N, int S = step_size>
+    static void __attribute__((flatten))
+    run_wave_steps_ntones(int16_t *data, size_t nsteps, const int*,
+                          channel_param_fixed *const *params, const uint32_t *const *phase,
+                          const uint32_t *const *dphase)
+    {
+        _run_wave_steps<Gen, 1, S>(data, nsteps, nchns_t<N>(), params, phase, dphase);
+    }
+};
+
+template<Precision prec = Precision::Default>
+struct ScalarGenT {
+    static const char *name()
+    {
+        return "Scalar";
+    }
+    static bool supported()
+    {
+        return true;
+    }
+    // Constant tones are generated with `FFTSynth` instead if there are at least
+    // this many tones per channel on average.
+    // This is the crossover measured by `test-data_stream_perf`.
+    static constexpr int fft_min_tones = 8;
+    // `DataStream` uses the kernels unrolled for the tone count (`run_wave_steps_ntones`)
+    // up to this many tones. They were faster with 4 to 16 tones in the benchmark
+    // and about the same with fewer.
+    static constexpr int unroll_max_tones = 16;
+    template<int S = step_size, typename T>
+    static NACS_INLINE void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                                            const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i++) {
+            float o = 0;
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += scalar::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+            }
+            scalar::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static NACS_INLINE void calc_wave(T *OUT_ATTR output, int nchns,
+                                      const channel_param *PARAM_ATTR params,
+                                      size_t param_idx)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i++) {
+            float o = 0;
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += scalar::calc_single_chn<S, prec>(i, p.phase[param_idx],
+                                                   p.freq[param_idx], p.amp[param_idx],
+                                                   p.dfreq[param_idx], p.damp[param_idx]);
+            }
+            scalar::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static NACS_INLINE void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                                             const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i++) {
+            float o = 0;
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += scalar::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                   p.dfreq, p.damp);
+            }
+            scalar::store(&output[i], o);
+        }
+    }
+    template<int S = step_size>
+    static NACS_INLINE float calc_chn(int i, const channel_param_fixed &p)
+    {
+        return scalar::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+    }
+    // The ramps can be disabled at compile time for the tones that don't use them.
+    template<int S = step_size, bool dfreq = true, bool damp = true>
+    static NACS_INLINE float calc_chn(int i, const channel_param_packed &p)
+    {
+        return scalar::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                dfreq ? p.dfreq : 0, damp ? p.damp : 0);
+    }
+    template<int S = step_size>
+    static NACS_INLINE float calc_chn(int i, const channel_param_ramp2 &p)
+    {
+        return scalar::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp, p.dfreq, p.damp,
+                                                p.ddfreq, p.ddamp);
+    }
+    // Sum of the tones of an output channel starting at sample `i`.
+    template<int S = step_size, typename P>
+    static NACS_INLINE float sum_chns(int i, int nchns, const P *params)
+    {
+        float v = 0;
+        for (int c = 0; c < nchns; c++)
+            v += calc_chn<S>(i, params[c]);
+        return v;
+    }
+    // Fully unrolled for a tone count known at compile time (`ntones_t`).
+    template<int S = step_size, typename P, int... K>
+    static NACS_INLINE float sum_chns(int i, std::integer_sequence<int, K...>,
+                                      const P *params)
+    {
+        float v = 0;
+        (void)std::initializer_list<int>{(v += calc_chn<S>(i, params[K]), 0)...};
+        return v;
+    }
+    template<int S = step_size>
+    static NACS_INLINE float sum_chns(int i, int nchns, const channel_param_groups *groups)
+    {
+        auto ps = groups->params;
+        float v = 0;
+        for (int c = 0; c < groups->nfixed; c++)
+            v += calc_chn<S, false, false>(i, ps[c]);
+        for (int c = groups->nfixed; c < groups->nfreq; c++)
+            v += calc_chn<S, true, false>(i, ps[c]);
+        for (int c = groups->nfreq; c < groups->namp; c++)
+            v += calc_chn<S, false, true>(i, ps[c]);
+        for (int c = groups->namp; c < nchns; c++)
+            v += calc_chn<S>(i, ps[c]);
+        return v;
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static NACS_INLINE void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                                            const P *const *PARAM_ATTR params)
+    {
+        for (int i = 0; i < S; i++) {
+            for (int o = 0; o < nout; o++) {
+                scalar::store(&output[i * nout + o], sum_chns<S>(i, nchns[o], params[o]));
+            }
+        }
+    }
+};
+using ScalarGen = ScalarGenT<>;
+
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+template<Precision prec = Precision::Default>
+struct SSE2GenT {
+    static const char *name()
+    {
+        return "SSE2";
+    }
+    static bool supported()
+    {
+        // Part of the x86-64 baseline.
+        return true;
+    }
+    static constexpr int fft_min_tones = 24;
+    // The unrolled kernels weren't measurably faster than the loop.
+    static constexpr int unroll_max_tones = 0;
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("sse2")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 4) {
+            auto o = _mm_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += sse2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+            }
+            sse2::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("sse2")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 4) {
+            auto o = _mm_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += sse2::calc_single_chn<S, prec>(i, p.phase[param_idx],
+                                                 p.freq[param_idx], p.amp[param_idx],
+                                                 p.dfreq[param_idx], p.damp[param_idx]);
+            }
+            sse2::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("sse2")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 4) {
+            auto o = _mm_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += sse2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                 p.dfreq, p.damp);
+            }
+            sse2::store(&output[i], o);
+        }
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("sse2")))
+    __m128 calc_chn(int i, const channel_param_fixed &p)
+    {
+        return sse2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+    }
+    // The ramps can be disabled at compile time for the tones that don't use them.
+    template<int S = step_size, bool dfreq = true, bool damp = true>
+    static inline __attribute__((target("sse2")))
+    __m128 calc_chn(int i, const channel_param_packed &p)
+    {
+        return sse2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                              dfreq ? p.dfreq : 0, damp ? p.damp : 0);
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("sse2")))
+    __m128 calc_chn(int i, const channel_param_ramp2 &p)
+    {
+        return sse2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp, p.dfreq, p.damp,
+                                              p.ddfreq, p.ddamp);
+    }
+    // Sum of the tones of an output channel for the 8 samples starting at `i`.
+    template<int S = step_size, typename P>
+    static inline __attribute__((target("sse2")))
+    void sum_chns(int i, int nchns, const P *params, __m128 &v0, __m128 &v1)
+    {
+        v0 = _mm_set1_ps(0);
+        v1 = _mm_set1_ps(0);
+        for (int c = 0; c < nchns; c++) {
+            v0 += calc_chn<S>(i, params[c]);
+            v1 += calc_chn<S>(i + 4, params[c]);
+        }
+    }
+    // Fully unrolled for a tone count known at compile time (`ntones_t`).
+    template<int S = step_size, typename P, int... K>
+    static inline __attribute__((target("sse2")))
+    void sum_chns(int i, std::integer_sequence<int, K...>, const P *params,
+                  __m128 &v0, __m128 &v1)
+    {
+        v0 = _mm_set1_ps(0);
+        v1 = _mm_set1_ps(0);
+        (void)std::initializer_list<int>{(v0 += calc_chn<S>(i, params[K]),
+                                          v1 += calc_chn<S>(i + 4, params[K]), 0)...};
+    }
+    template<int S = step_size, bool dfreq, bool damp>
+    static inline __attribute__((target("sse2")))
+    void sum_group(int i, int c0, int c1, const channel_param_packed *params,
+                   __m128 &v0, __m128 &v1)
+    {
+        for (int c = c0; c < c1; c++) {
+            v0 += calc_chn<S, dfreq, damp>(i, params[c]);
+            v1 += calc_chn<S, dfreq, damp>(i + 4, params[c]);
+        }
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("sse2")))
+    void sum_chns(int i, int nchns, const channel_param_groups *groups,
+                  __m128 &v0, __m128 &v1)
+    {
+        auto ps = groups->params;
+        v0 = _mm_set1_ps(0);
+        v1 = _mm_set1_ps(0);
+        sum_group<S, false, false>(i, 0, groups->nfixed, ps, v0, v1);
+        sum_group<S, true, false>(i, groups->nfixed, groups->nfreq, ps, v0, v1);
+        sum_group<S, false, true>(i, groups->nfreq, groups->namp, ps, v0, v1);
+        sum_group<S, true, true>(i, groups->namp, nchns, ps, v0, v1);
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static inline __attribute__((target("sse2")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        for (int i = 0; i < S; i += 8) {
+            __m128i v[nout];
+            for (int o = 0; o < nout; o++) {
+                __m128 v0, v1;
+                sum_chns<S>(i, nchns[o], params[o], v0, v1);
+                v[o] = sse2::cvt_i16(v0, v1);
+            }
+            sse2::store_interleave<nout>(&output[i * nout], v);
+        }
+    }
+};
+using SSE2Gen = SSE2GenT<>;
+template<Precision prec>
+struct Runner<SSE2GenT<prec>> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("sse2"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<SSE2GenT<prec>, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("sse2"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<SSE2GenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("sse2"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<SSE2GenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("sse2"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<SSE2GenT<prec>, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("sse2"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<SSE2GenT<prec>, nout, S>(data, nsteps, nchns, params,
+                                                 phase, dphase);
+    }
+    // Single output channel with `N` tones (`nchns[0] == N`).
+    template<int N, int S = step_size>
+    static void __attribute__((target("sse2"), flatten))
+    run_wave_steps_ntones(int16_t *data, size_t nsteps, const int*,
+                          channel_param_fixed *const *params, const uint32_t *const *phase,
+                          const uint32_t *const *dphase)
+    {
+        _run_wave_steps<SSE2GenT<prec>, 1, S>(data, nsteps, nchns_t<N>(), params,
+                                              phase, dphase);
+    }
+};
+
+template<Precision prec = Precision::Default>
+struct AVXGenT {
+    static const char *name()
+    {
+        return "AVX";
+    }
+    static bool supported()
+    {
+        return CPUInfo::get_host().test_feature(X86::Feature::avx);
+    }
+    static constexpr int fft_min_tones = 64;
+    // The unrolled kernels weren't measurably faster than the loop.
+    static constexpr int unroll_max_tones = 0;
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 8) {
+            auto o = _mm256_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+            }
+            avx::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 8) {
+            auto o = _mm256_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx::calc_single_chn<S, prec>(i, p.phase[param_idx],
+                                                p.freq[param_idx], p.amp[param_idx],
+                                                p.dfreq[param_idx], p.damp[param_idx]);
+            }
+            avx::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 8) {
+            auto o = _mm256_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                p.dfreq, p.damp);
+            }
+            avx::store(&output[i], o);
+        }
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx")))
+    __m256 calc_chn(int i, const channel_param_fixed &p)
+    {
+        return avx::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+    }
+    // The ramps can be disabled at compile time for the tones that don't use them.
+    template<int S = step_size, bool dfreq = true, bool damp = true>
+    static inline __attribute__((target("avx")))
+    __m256 calc_chn(int i, const channel_param_packed &p)
+    {
+        return avx::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                             dfreq ? p.dfreq : 0, damp ? p.damp : 0);
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx")))
+    __m256 calc_chn(int i, const channel_param_ramp2 &p)
+    {
+        return avx::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp, p.dfreq, p.damp,
+                                             p.ddfreq, p.ddamp);
+    }
+    // Sum of the tones of an output channel starting at sample `i`.
+    template<int S = step_size, typename P>
+    static inline __attribute__((target("avx")))
+    __m256 sum_chns(int i, int nchns, const P *params)
+    {
+        auto vf = _mm256_set1_ps(0);
+        for (int c = 0; c < nchns; c++)
+            vf += calc_chn<S>(i, params[c]);
+        return vf;
+    }
+    // Fully unrolled for a tone count known at compile time (`ntones_t`).
+    template<int S = step_size, typename P, int... K>
+    static inline __attribute__((target("avx")))
+    __m256 sum_chns(int i, std::integer_sequence<int, K...>, const P *params)
+    {
+        auto vf = _mm256_set1_ps(0);
+        (void)std::initializer_list<int>{(vf += calc_chn<S>(i, params[K]), 0)...};
+        return vf;
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx")))
+    __m256 sum_chns(int i, int nchns, const channel_param_groups *groups)
+    {
+        auto ps = groups->params;
+        auto vf = _mm256_set1_ps(0);
+        for (int c = 0; c < groups->nfixed; c++)
+            vf += calc_chn<S, false, false>(i, ps[c]);
+        for (int c = groups->nfixed; c < groups->nfreq; c++)
+            vf += calc_chn<S, true, false>(i, ps[c]);
+        for (int c = groups->nfreq; c < groups->namp; c++)
+            vf += calc_chn<S, false, true>(i, ps[c]);
+        for (int c = groups->namp; c < nchns; c++)
+            vf += calc_chn<S>(i, ps[c]);
+        return vf;
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static inline __attribute__((target("avx")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        for (int i = 0; i < S; i += 8) {
+            __m128i v[nout];
+            for (int o = 0; o < nout; o++) {
+                v[o] = avx::cvt_i16(sum_chns<S>(i, nchns[o], params[o]));
+            }
+            sse2::store_interleave<nout>(&output[i * nout], v);
+        }
+    }
+};
+using AVXGen = AVXGenT<>;
+template<Precision prec>
+struct Runner<AVXGenT<prec>> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<AVXGenT<prec>, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<AVXGenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<AVXGenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("avx"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<AVXGenT<prec>, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("avx"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVXGenT<prec>, nout, S>(data, nsteps, nchns, params, phase, dphase);
+    }
+    // Single output channel with `N` tones (`nchns[0] == N`).
+    template<int N, int S = step_size>
+    static void __attribute__((target("avx"), flatten))
+    run_wave_steps_ntones(int16_t *data, size_t nsteps, const int*,
+                          channel_param_fixed *const *params, const uint32_t *const *phase,
+                          const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVXGenT<prec>, 1, S>(data, nsteps, nchns_t<N>(), params,
+                                             phase, dphase);
+    }
+};
+
+template<Precision prec = Precision::Default>
+struct AVX2GenT {
+    static const char *name()
+    {
+        return "AVX2";
+    }
+    static bool supported()
+    {
+        auto &host = CPUInfo::get_host();
+        return (host.test_feature(X86::Feature::avx2) &&
+                host.test_feature(X86::Feature::fma));
+    }
+    static constexpr int fft_min_tones = 96;
+    // The unrolled kernels weren't measurably faster than the loop.
+    static constexpr int unroll_max_tones = 0;
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 8) {
+            auto o = _mm256_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+            }
+            avx2::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 8) {
+            auto o = _mm256_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx2::calc_single_chn<S, prec>(i, p.phase[param_idx],
+                                                 p.freq[param_idx], p.amp[param_idx],
+                                                 p.dfreq[param_idx], p.damp[param_idx]);
+            }
+            avx2::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 8) {
+            auto o = _mm256_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                 p.dfreq, p.damp);
+            }
+            avx2::store(&output[i], o);
+        }
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx2,fma")))
+    __m256 calc_chn(int i, const channel_param_fixed &p)
+    {
+        return avx2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+    }
+    // The ramps can be disabled at compile time for the tones that don't use them.
+    template<int S = step_size, bool dfreq = true, bool damp = true>
+    static inline __attribute__((target("avx2,fma")))
+    __m256 calc_chn(int i, const channel_param_packed &p)
+    {
+        return avx2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                              dfreq ? p.dfreq : 0, damp ? p.damp : 0);
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx2,fma")))
+    __m256 calc_chn(int i, const channel_param_ramp2 &p)
+    {
+        return avx2::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp, p.dfreq, p.damp,
+                                              p.ddfreq, p.ddamp);
+    }
+    // Sum of the tones of an output channel starting at sample `i`.
+    template<int S = step_size, typename P>
+    static inline __attribute__((target("avx2,fma")))
+    __m256 sum_chns(int i, int nchns, const P *params)
+    {
+        auto vf = _mm256_set1_ps(0);
+        for (int c = 0; c < nchns; c++)
+            vf += calc_chn<S>(i, params[c]);
+        return vf;
+    }
+    // Fully unrolled for a tone count known at compile time (`ntones_t`).
+    template<int S = step_size, typename P, int... K>
+    static inline __attribute__((target("avx2,fma")))
+    __m256 sum_chns(int i, std::integer_sequence<int, K...>, const P *params)
+    {
+        auto vf = _mm256_set1_ps(0);
+        (void)std::initializer_list<int>{(vf += calc_chn<S>(i, params[K]), 0)...};
+        return vf;
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx2,fma")))
+    __m256 sum_chns(int i, int nchns, const channel_param_groups *groups)
+    {
+        auto ps = groups->params;
+        auto vf = _mm256_set1_ps(0);
+        for (int c = 0; c < groups->nfixed; c++)
+            vf += calc_chn<S, false, false>(i, ps[c]);
+        for (int c = groups->nfixed; c < groups->nfreq; c++)
+            vf += calc_chn<S, true, false>(i, ps[c]);
+        for (int c = groups->nfreq; c < groups->namp; c++)
+            vf += calc_chn<S, false, true>(i, ps[c]);
+        for (int c = groups->namp; c < nchns; c++)
+            vf += calc_chn<S>(i, ps[c]);
+        return vf;
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        for (int i = 0; i < S; i += 8) {
+            __m128i v[nout];
+            for (int o = 0; o < nout; o++) {
+                v[o] = avx2::cvt_i16(sum_chns<S>(i, nchns[o], params[o]));
+            }
+            sse2::store_interleave<nout>(&output[i * nout], v);
+        }
+    }
+};
+using AVX2Gen = AVX2GenT<>;
+template<Precision prec>
+struct Runner<AVX2GenT<prec>> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<AVX2GenT<prec>, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<AVX2GenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<AVX2GenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<AVX2GenT<prec>, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVX2GenT<prec>, nout, S>(data, nsteps, nchns, params,
+                                                 phase, dphase);
+    }
+    // Single output channel with `N` tones (`nchns[0] == N`).
+    template<int N, int S = step_size>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_steps_ntones(int16_t *data, size_t nsteps, const int*,
+                          channel_param_fixed *const *params, const uint32_t *const *phase,
+                          const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVX2GenT<prec>, 1, S>(data, nsteps, nchns_t<N>(), params,
+                                              phase, dphase);
+    }
+};
+
+// Same as `AVX2Gen` except that the constant tones are computed by rotating a phasor
+// from one sample to the next instead of evaluating the sine function for every sample.
+// The phasor is seeded from the exact phase at the beginning of each step
+// and the rotation is renormalized so the error doesn't accumulate over the step.
+// This is vectorized across tones so the cost for each sample is only
+// a complex multiplication and an addition, plus a horizontal sum per sample for each step.
+// It's faster than `AVX2Gen` with more than ~50 tones and much slower with only a few
+// so it's not used by `DataStream` for now.
+// The ramps use the `AVX2Gen` kernels.
+struct RotatorGen {
+    static const char *name()
+    {
+        return "Rotator";
+    }
+    static bool supported()
+    {
+        return AVX2Gen::supported();
+    }
+    static constexpr int fft_min_tones = 128;
+    // The phasors of 8 tones and their rotation per sample.
+    struct Phasor {
+        __m256 zr;
+        __m256 zi;
+        __m256 rr;
+        __m256 ri;
+    };
+    template<int S>
+    static NACS_INLINE __attribute__((target("avx2,fma")))
+    Phasor seed(const float *phase, const float *freq, const float *amp)
+    {
+        constexpr float pi = float(M_PI);
+        Phasor p;
+        auto dphase = _mm256_load_ps(freq) * (2.0f / S);
+        p.rr = avx2::sinpif_pi(dphase + 0.5f) * pi;
+        p.ri = avx2::sinpif_pi(dphase) * pi;
+        auto norm = 1.5f - 0.5f * (p.rr * p.rr + p.ri * p.ri);
+        p.rr = p.rr * norm;
+        p.ri = p.ri * norm;
+        // The phasor includes the amplitude (and the `1 / pi` of `sinpif_pi`).
+        auto vphase = _mm256_load_ps(phase);
+        auto vamp = _mm256_load_ps(amp);
+        p.zr = avx2::sinpif_pi(vphase + 0.5f) * vamp;
+        p.zi = avx2::sinpif_pi(vphase) * vamp;
+        return p;
+    }
+    // Return the output for the current sample and move to the next one.
+    static NACS_INLINE __attribute__((target("avx2,fma")))
+    __m256 next(Phasor &p)
+    {
+        auto res = p.zi;
+        auto zr = _mm256_fmsub_ps(p.zr, p.rr, p.zi * p.ri);
+        p.zi = _mm256_fmadd_ps(p.zr, p.ri, p.zi * p.rr);
+        p.zr = zr;
+        return res;
+    }
+    // Each rotation depends on the previous one so we compute 4 vectors (32 tones)
+    // together to hide the latency.
+    template<int S = step_size>
+    static inline __attribute__((target("avx2,fma")))
+    void sum_tones(float *OUT_ATTR sums, int nchns,
+                   const channel_param_fixed *PARAM_ATTR params)
+    {
+        __m256 acc[S];
+        for (int i = 0; i < S; i++)
+            acc[i] = _mm256_setzero_ps();
+        for (int c0 = 0; c0 < nchns; c0 += 32) {
+            alignas(32) float phase[32];
+            alignas(32) float freq[32];
+            alignas(32) float amp[32];
+            for (int c = 0; c < 32; c++) {
+                bool valid = c0 + c < nchns;
+                auto &p = params[valid ? c0 + c : c0];
+                phase[c] = valid ? p.phase : 0;
+                freq[c] = valid ? p.freq : 0;
+                amp[c] = valid ? p.amp : 0;
+            }
+            auto p0 = seed<S>(&phase[0], &freq[0], &amp[0]);
+            auto p1 = seed<S>(&phase[8], &freq[8], &amp[8]);
+            auto p2 = seed<S>(&phase[16], &freq[16], &amp[16]);
+            auto p3 = seed<S>(&phase[24], &freq[24], &amp[24]);
+            for (int i = 0; i < S; i++) {
+                acc[i] += (next(p0) + next(p1)) + (next(p2) + next(p3));
+            }
+        }
+        for (int i = 0; i < S; i++) {
+            sums[i] = avx2::hsum(acc[i]);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        alignas(64) float sums[S];
+        sum_tones<S>(sums, nchns, params);
+        for (int i = 0; i < S; i += 8) {
+            avx2::store(&output[i], _mm256_load_ps(&sums[i]));
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        AVX2Gen::calc_wave<S>(output, nchns, params, param_idx);
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        AVX2Gen::calc_wave_packed<S>(output, nchns, params);
+    }
+    template<int nout, int S = step_size, typename NC>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                         const channel_param_fixed *const *PARAM_ATTR params)
+    {
+        alignas(64) float sums[nout][S];
+        for (int o = 0; o < nout; o++) {
+            if (nchns[o] > 0) {
+                sum_tones<S>(sums[o], nchns[o], params[o]);
+                continue;
+            }
+            for (int i = 0; i < S; i++) {
+                sums[o][i] = 0;
+            }
+        }
+        for (int i = 0; i < S; i += 8) {
+            __m128i v[nout];
+            for (int o = 0; o < nout; o++)
+                v[o] = avx2::cvt_i16(_mm256_load_ps(&sums[o][i]));
+            sse2::store_interleave<nout>(&output[i * nout], v);
+        }
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        AVX2Gen::calc_wave_multi<nout, S>(output, nchns, params);
+    }
+};
+template<>
+struct Runner<RotatorGen> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<RotatorGen, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<RotatorGen, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<RotatorGen, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<RotatorGen, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<RotatorGen, nout, S>(data, nsteps, nchns, params, phase, dphase);
+    }
+    // Single output channel with `N` tones (`nchns[0] == N`).
+    template<int N, int S = step_size>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_steps_ntones(int16_t *data, size_t nsteps, const int*,
+                          channel_param_fixed *const *params, const uint32_t *const *phase,
+                          const uint32_t *const *dphase)
+    {
+        _run_wave_steps<RotatorGen, 1, S>(data, nsteps, nchns_t<N>(), params,
+                                          phase, dphase);
+    }
+};
+
+// Integer version of `AVX2Gen` that computes 16 samples per vector instead of 8.
+// The phase and amplitude of each tone are tracked in 32bit fixed point (`q15::Tone`)
+// and the sine is evaluated on the top 16 bits of the phase with a Q15 polynomial
+// using `mulhrs` (`avx2::sinpi_q15`).
+// The error from the polynomial and the 16bit phase is up to ~5 LSB of the full output
+// range in addition to the rounding of each tone,
+// compared to the half LSB of the floating point generators.
+// The partial sums saturate so the output is only exact if the sum of the amplitudes
+// fits in 16 bits and the amplitude of each tone must stay within the 16 bits.
+// The `float` output is converted from the 16bit result.
+// It's slower than `AVX2Gen` on the CPUs tested so far so it's not used by `DataStream`.
+struct AVX2Q15Gen {
+    static const char *name()
+    {
+        return "AVX2 (Q15)";
+    }
+    static bool supported()
+    {
+        return AVX2Gen::supported();
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        __m256i acc[S / 16] = {};
+        for (int c = 0; c < nchns; c++)
+            add_chn<S>(acc, params[c]);
+        for (int k = 0; k < S / 16; k++)
+            avx2::store_q15(&output[k * 16], acc[k]);
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        assume(nchns > 0);
+        __m256i acc[S / 16] = {};
+        for (int c = 0; c < nchns; c++) {
+            auto p = params[c];
+            avx2::add_tone_q15<S, true>(
+                acc, q15::tone<S>(p.phase[param_idx], p.freq[param_idx], p.amp[param_idx],
+                                  p.dfreq[param_idx], p.damp[param_idx]));
+        }
+        for (int k = 0; k < S / 16; k++)
+            avx2::store_q15(&output[k * 16], acc[k]);
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        __m256i acc[S / 16] = {};
+        for (int c = 0; c < nchns; c++)
+            add_chn<S>(acc, params[c]);
+        for (int k = 0; k < S / 16; k++)
+            avx2::store_q15(&output[k * 16], acc[k]);
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx2,fma")))
+    void add_chn(__m256i *acc, const channel_param_fixed &p)
+    {
+        avx2::add_tone_q15<S, false>(acc, q15::tone<S>(p.phase, p.freq, p.amp));
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx2,fma")))
+    void add_chn(__m256i *acc, const channel_param_packed &p)
+    {
+        avx2::add_tone_q15<S, true>(acc, q15::tone<S>(p.phase, p.freq, p.amp,
+                                                       p.dfreq, p.damp));
+    }
+    template<int nout, int S = step_size, typename P>
+    static inline __attribute__((target("avx2,fma")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, const int *nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        __m256i acc[nout][S / 16] = {};
+        for (int o = 0; o < nout; o++) {
+            for (int c = 0; c < nchns[o]; c++) {
+                add_chn<S>(acc[o], params[o][c]);
+            }
+        }
+        for (int k = 0; k < S / 16; k++) {
+            for (int h = 0; h < 2; h++) {
+                __m128i v[nout];
+                for (int o = 0; o < nout; o++)
+                    v[o] = h == 0 ? _mm256_castsi256_si128(acc[o][k]) :
+                        _mm256_extracti128_si256(acc[o][k], 1);
+                sse2::store_interleave<nout>(&output[(k * 16 + h * 8) * nout], v);
+            }
+        }
+    }
+};
+template<>
+struct Runner<AVX2Q15Gen> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<AVX2Q15Gen, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<AVX2Q15Gen, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<AVX2Q15Gen, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<AVX2Q15Gen, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("avx2,fma"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVX2Q15Gen, nout, S>(data, nsteps, nchns, params, phase, dphase);
+    }
+};
+
+template<Precision prec = Precision::Default>
+struct AVX512GenT {
+    static const char *name()
+    {
+        return "AVX512";
+    }
+    static bool supported()
+    {
+        auto &host = CPUInfo::get_host();
+        return (host.test_feature(X86::Feature::avx512f) &&
+                host.test_feature(X86::Feature::avx512dq));
+    }
+    static constexpr int fft_min_tones = 160;
+    // The unrolled kernels were only faster with 1 or 2 tones.
+    static constexpr int unroll_max_tones = 2;
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 16) {
+            auto o = _mm512_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx512::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+            }
+            avx512::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 16) {
+            auto o = _mm512_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx512::calc_single_chn<S, prec>(i, p.phase[param_idx],
+                                                   p.freq[param_idx], p.amp[param_idx],
+                                                   p.dfreq[param_idx], p.damp[param_idx]);
+            }
+            avx512::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 16) {
+            auto o = _mm512_set1_ps(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o += avx512::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                   p.dfreq, p.damp);
+            }
+            avx512::store(&output[i], o);
+        }
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    __m512 calc_chn(int i, const channel_param_fixed &p)
+    {
+        return avx512::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+    }
+    // The ramps can be disabled at compile time for the tones that don't use them.
+    template<int S = step_size, bool dfreq = true, bool damp = true>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    __m512 calc_chn(int i, const channel_param_packed &p)
+    {
+        return avx512::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                dfreq ? p.dfreq : 0, damp ? p.damp : 0);
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    __m512 calc_chn(int i, const channel_param_ramp2 &p)
+    {
+        return avx512::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp, p.dfreq, p.damp,
+                                                p.ddfreq, p.ddamp);
+    }
+    // Sum of the tones of an output channel starting at sample `i`.
+    template<int S = step_size, typename P>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    __m512 sum_chns(int i, int nchns, const P *params)
+    {
+        auto vf = _mm512_set1_ps(0);
+        for (int c = 0; c < nchns; c++)
+            vf += calc_chn<S>(i, params[c]);
+        return vf;
+    }
+    // Fully unrolled for a tone count known at compile time (`ntones_t`).
+    template<int S = step_size, typename P, int... K>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    __m512 sum_chns(int i, std::integer_sequence<int, K...>, const P *params)
+    {
+        auto vf = _mm512_set1_ps(0);
+        (void)std::initializer_list<int>{(vf += calc_chn<S>(i, params[K]), 0)...};
+        return vf;
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    __m512 sum_chns(int i, int nchns, const channel_param_groups *groups)
+    {
+        auto ps = groups->params;
+        auto vf = _mm512_set1_ps(0);
+        for (int c = 0; c < groups->nfixed; c++)
+            vf += calc_chn<S, false, false>(i, ps[c]);
+        for (int c = groups->nfixed; c < groups->nfreq; c++)
+            vf += calc_chn<S, true, false>(i, ps[c]);
+        for (int c = groups->nfreq; c < groups->namp; c++)
+            vf += calc_chn<S, false, true>(i, ps[c]);
+        for (int c = groups->namp; c < nchns; c++)
+            vf += calc_chn<S>(i, ps[c]);
+        return vf;
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static inline __attribute__((target("avx512f,avx512dq")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        for (int i = 0; i < S; i += 16) {
+            __m128i lo[nout];
+            __m128i hi[nout];
+            for (int o = 0; o < nout; o++) {
+                auto vi = avx512::cvt_i16(sum_chns<S>(i, nchns[o], params[o]));
+                lo[o] = _mm256_castsi256_si128(vi);
+                hi[o] = _mm256_extracti128_si256(vi, 1);
+            }
+            sse2::store_interleave<nout>(&output[i * nout], lo);
+            sse2::store_interleave<nout>(&output[(i + 8) * nout], hi);
+        }
+    }
+};
+using AVX512Gen = AVX512GenT<>;
+template<Precision prec>
+struct Runner<AVX512GenT<prec>> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx512f,avx512dq"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<AVX512GenT<prec>, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx512f,avx512dq"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<AVX512GenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx512f,avx512dq"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<AVX512GenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("avx512f,avx512dq"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<AVX512GenT<prec>, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("avx512f,avx512dq"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVX512GenT<prec>, nout, S>(data, nsteps, nchns, params,
+                                                   phase, dphase);
+    }
+    // Single output channel with `N` tones (`nchns[0] == N`).
+    template<int N, int S = step_size>
+    static void __attribute__((target("avx512f,avx512dq"), flatten))
+    run_wave_steps_ntones(int16_t *data, size_t nsteps, const int*,
+                          channel_param_fixed *const *params, const uint32_t *const *phase,
+                          const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVX512GenT<prec>, 1, S>(data, nsteps, nchns_t<N>(), params,
+                                                phase, dphase);
+    }
+};
+
+// The AVX512 version of `AVX2Q15Gen` with 32 samples per vector.
+// The step size must be a multiple of 32.
+struct AVX512Q15Gen {
+    static const char *name()
+    {
+        return "AVX512 (Q15)";
+    }
+    static bool supported()
+    {
+        return (AVX512Gen::supported() &&
+                CPUInfo::get_host().test_feature(X86::Feature::avx512bw));
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx512f,avx512dq,avx512bw")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        __m512i acc[S / 32] = {};
+        for (int c = 0; c < nchns; c++)
+            add_chn<S>(acc, params[c]);
+        for (int k = 0; k < S / 32; k++)
+            avx512::store_q15(&output[k * 32], acc[k]);
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx512f,avx512dq,avx512bw")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        assume(nchns > 0);
+        __m512i acc[S / 32] = {};
+        for (int c = 0; c < nchns; c++) {
+            auto p = params[c];
+            avx512::add_tone_q15<S, true>(
+                acc, q15::tone<S>(p.phase[param_idx], p.freq[param_idx], p.amp[param_idx],
+                                  p.dfreq[param_idx], p.damp[param_idx]));
+        }
+        for (int k = 0; k < S / 32; k++)
+            avx512::store_q15(&output[k * 32], acc[k]);
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("avx512f,avx512dq,avx512bw")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        __m512i acc[S / 32] = {};
+        for (int c = 0; c < nchns; c++)
+            add_chn<S>(acc, params[c]);
+        for (int k = 0; k < S / 32; k++)
+            avx512::store_q15(&output[k * 32], acc[k]);
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx512f,avx512dq,avx512bw")))
+    void add_chn(__m512i *acc, const channel_param_fixed &p)
+    {
+        avx512::add_tone_q15<S, false>(acc, q15::tone<S>(p.phase, p.freq, p.amp));
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("avx512f,avx512dq,avx512bw")))
+    void add_chn(__m512i *acc, const channel_param_packed &p)
+    {
+        avx512::add_tone_q15<S, true>(acc, q15::tone<S>(p.phase, p.freq, p.amp,
+                                                       p.dfreq, p.damp));
+    }
+    template<int nout, int S = step_size, typename P>
+    static inline __attribute__((target("avx512f,avx512dq,avx512bw")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, const int *nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        __m512i acc[nout][S / 32] = {};
+        for (int o = 0; o < nout; o++) {
+            for (int c = 0; c < nchns[o]; c++) {
+                add_chn<S>(acc[o], params[o][c]);
+            }
+        }
+        for (int k = 0; k < S / 32; k++) {
+            for (int h = 0; h < 4; h++) {
+                __m128i v[nout];
+                for (int o = 0; o < nout; o++)
+                    v[o] = avx512::extract128(acc[o][k], h);
+                sse2::store_interleave<nout>(&output[(k * 32 + h * 8) * nout], v);
+            }
+        }
+    }
+};
+template<>
+struct Runner<AVX512Q15Gen> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx512f,avx512dq,avx512bw"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<AVX512Q15Gen, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx512f,avx512dq,avx512bw"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<AVX512Q15Gen, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("avx512f,avx512dq,avx512bw"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<AVX512Q15Gen, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("avx512f,avx512dq,avx512bw"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<AVX512Q15Gen, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("avx512f,avx512dq,avx512bw"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<AVX512Q15Gen, nout, S>(data, nsteps, nchns, params, phase, dphase);
+    }
+};
+#elif NACS_CPU_AARCH64
+// NEON is part of the AArch64 baseline so this doesn't need a `target` attribute
+// or a `Runner` specialization.
+template<Precision prec = Precision::Default>
+struct NEONGenT {
+    static const char *name()
+    {
+        return "NEON";
+    }
+    static bool supported()
+    {
+        return true;
+    }
+    // The crossovers are not measured on ARM hardware yet. Use the scalar one for the FFT
+    // and only the generic kernels (`run_wave_steps`) until they are.
+    static constexpr int fft_min_tones = ScalarGenT<prec>::fft_min_tones;
+    static constexpr int unroll_max_tones = 0;
+    template<int S = step_size, typename T>
+    static NACS_INLINE void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                                            const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 4) {
+            auto o = vdupq_n_f32(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o = vaddq_f32(o, neon::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp));
+            }
+            neon::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static NACS_INLINE void calc_wave(T *OUT_ATTR output, int nchns,
+                                      const channel_param *PARAM_ATTR params,
+                                      size_t param_idx)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 4) {
+            auto o = vdupq_n_f32(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o = vaddq_f32(o, neon::calc_single_chn<S, prec>(
+                                  i, p.phase[param_idx], p.freq[param_idx],
+                                  p.amp[param_idx], p.dfreq[param_idx],
+                                  p.damp[param_idx]));
+            }
+            neon::store(&output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static NACS_INLINE void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                                             const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += 4) {
+            auto o = vdupq_n_f32(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o = vaddq_f32(o, neon::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                                                p.dfreq, p.damp));
+            }
+            neon::store(&output[i], o);
+        }
+    }
+    template<int S = step_size>
+    static NACS_INLINE float32x4_t calc_chn(int i, const channel_param_fixed &p)
+    {
+        return neon::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp);
+    }
+    // The ramps can be disabled at compile time for the tones that don't use them.
+    template<int S = step_size, bool dfreq = true, bool damp = true>
+    static NACS_INLINE float32x4_t calc_chn(int i, const channel_param_packed &p)
+    {
+        return neon::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp,
+                                              dfreq ? p.dfreq : 0, damp ? p.damp : 0);
+    }
+    template<int S = step_size>
+    static NACS_INLINE float32x4_t calc_chn(int i, const channel_param_ramp2 &p)
+    {
+        return neon::calc_single_chn<S, prec>(i, p.phase, p.freq, p.amp, p.dfreq, p.damp,
+                                              p.ddfreq, p.ddamp);
+    }
+    // Sum of the tones of an output channel starting at sample `i`.
+    template<int S = step_size, typename P>
+    static NACS_INLINE
+    float32x4_t sum_chns(int i, int nchns, const P *params)
+    {
+        auto vf = vdupq_n_f32(0);
+        for (int c = 0; c < nchns; c++)
+            vf = vaddq_f32(vf, calc_chn<S>(i, params[c]));
+        return vf;
+    }
+    // Fully unrolled for a tone count known at compile time (`ntones_t`).
+    template<int S = step_size, typename P, int... K>
+    static NACS_INLINE
+    float32x4_t sum_chns(int i, std::integer_sequence<int, K...>, const P *params)
+    {
+        auto vf = vdupq_n_f32(0);
+        (void)std::initializer_list<int>{
+            (vf = vaddq_f32(vf, calc_chn<S>(i, params[K])), 0)...};
+        return vf;
+    }
+    template<int S = step_size>
+    static NACS_INLINE
+    float32x4_t sum_chns(int i, int nchns, const channel_param_groups *groups)
+    {
+        auto ps = groups->params;
+        auto vf = vdupq_n_f32(0);
+        for (int c = 0; c < groups->nfixed; c++)
+            vf = vaddq_f32(vf, calc_chn<S, false, false>(i, ps[c]));
+        for (int c = groups->nfixed; c < groups->nfreq; c++)
+            vf = vaddq_f32(vf, calc_chn<S, true, false>(i, ps[c]));
+        for (int c = groups->nfreq; c < groups->namp; c++)
+            vf = vaddq_f32(vf, calc_chn<S, false, true>(i, ps[c]));
+        for (int c = groups->namp; c < nchns; c++)
+            vf = vaddq_f32(vf, calc_chn<S>(i, ps[c]));
+        return vf;
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static NACS_INLINE void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                                            const P *const *PARAM_ATTR params)
+    {
+        for (int i = 0; i < S; i += 4) {
+            int16x4_t v[nout];
+            for (int o = 0; o < nout; o++) {
+                v[o] = neon::cvt_i16(sum_chns<S>(i, nchns[o], params[o]));
+            }
+            neon::store_interleave<nout>(&output[i * nout], v);
+        }
+    }
+};
+using NEONGen = NEONGenT<>;
+
+#ifdef NACS_SPCM_SVE
+// Vector length agnostic, i.e. the same code runs on 128 to 2048 bit implementations.
+template<Precision prec = Precision::Default>
+struct SVEGenT {
+    static const char *name()
+    {
+        return "SVE";
+    }
+    static bool supported()
+    {
+        return CPUInfo::get_host().test_feature(AArch64::Feature::sve);
+    }
+    // Not measured on hardware yet, same as `NEONGenT`.
+    static constexpr int fft_min_tones = ScalarGenT<prec>::fft_min_tones;
+    static constexpr int unroll_max_tones = 0;
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("+sve")))
+    void calc_wave_fixed(T *OUT_ATTR output, int nchns,
+                         const channel_param_fixed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += int(svcntw())) {
+            auto pg = svwhilelt_b32(i, S);
+            svfloat32_t tscale, tscale_2;
+            sve::time_scale<S>(pg, i, tscale, tscale_2);
+            auto o = svdup_n_f32(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o = svadd_f32_x(pg, o, sve::calc_single_chn<S, prec>(
+                                    pg, tscale, tscale_2, p.phase, p.freq, p.amp));
+            }
+            sve::store(pg, &output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("+sve")))
+    void calc_wave(T *OUT_ATTR output, int nchns,
+                   const channel_param *PARAM_ATTR params, size_t param_idx)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += int(svcntw())) {
+            auto pg = svwhilelt_b32(i, S);
+            svfloat32_t tscale, tscale_2;
+            sve::time_scale<S>(pg, i, tscale, tscale_2);
+            auto o = svdup_n_f32(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o = svadd_f32_x(pg, o, sve::calc_single_chn<S, prec>(
+                                    pg, tscale, tscale_2, p.phase[param_idx],
+                                    p.freq[param_idx], p.amp[param_idx],
+                                    p.dfreq[param_idx], p.damp[param_idx]));
+            }
+            sve::store(pg, &output[i], o);
+        }
+    }
+    template<int S = step_size, typename T>
+    static inline __attribute__((target("+sve")))
+    void calc_wave_packed(T *OUT_ATTR output, int nchns,
+                          const channel_param_packed *PARAM_ATTR params)
+    {
+        assume(nchns > 0);
+        for (int i = 0; i < S; i += int(svcntw())) {
+            auto pg = svwhilelt_b32(i, S);
+            svfloat32_t tscale, tscale_2;
+            sve::time_scale<S>(pg, i, tscale, tscale_2);
+            auto o = svdup_n_f32(0);
+            for (int c = 0; c < nchns; c++) {
+                auto p = params[c];
+                o = svadd_f32_x(pg, o, sve::calc_single_chn<S, prec>(
+                                    pg, tscale, tscale_2, p.phase, p.freq, p.amp,
+                                    p.dfreq, p.damp));
+            }
+            sve::store(pg, &output[i], o);
+        }
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("+sve")))
+    svfloat32_t calc_chn(svbool_t pg, svfloat32_t tscale, svfloat32_t tscale_2,
+                         const channel_param_fixed &p)
+    {
+        return sve::calc_single_chn<S, prec>(pg, tscale, tscale_2, p.phase, p.freq, p.amp);
+    }
+    // The ramps can be disabled at compile time for the tones that don't use them.
+    template<int S = step_size, bool dfreq = true, bool damp = true>
+    static inline __attribute__((target("+sve")))
+    svfloat32_t calc_chn(svbool_t pg, svfloat32_t tscale, svfloat32_t tscale_2,
+                         const channel_param_packed &p)
+    {
+        return sve::calc_single_chn<S, prec>(pg, tscale, tscale_2, p.phase, p.freq, p.amp,
+                                             dfreq ? p.dfreq : 0, damp ? p.damp : 0);
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("+sve")))
+    svfloat32_t calc_chn(svbool_t pg, svfloat32_t tscale, svfloat32_t tscale_2,
+                         const channel_param_ramp2 &p)
+    {
+        return sve::calc_single_chn<S, prec>(pg, tscale, tscale_2, p.phase, p.freq, p.amp,
+                                             p.dfreq, p.damp, p.ddfreq, p.ddamp);
+    }
+    // Sum of the tones of an output channel.
+    template<int S = step_size, typename P>
+    static inline __attribute__((target("+sve")))
+    svfloat32_t sum_chns(svbool_t pg, svfloat32_t tscale, svfloat32_t tscale_2,
+                         int nchns, const P *params)
+    {
+        auto vf = svdup_n_f32(0);
+        for (int c = 0; c < nchns; c++)
+            vf = svadd_f32_x(pg, vf, calc_chn<S>(pg, tscale, tscale_2, params[c]));
+        return vf;
+    }
+    // Fully unrolled for a tone count known at compile time (`ntones_t`).
+    template<int S = step_size, typename P, int... K>
+    static inline __attribute__((target("+sve")))
+    svfloat32_t sum_chns(svbool_t pg, svfloat32_t tscale, svfloat32_t tscale_2,
+                         std::integer_sequence<int, K...>, const P *params)
+    {
+        auto vf = svdup_n_f32(0);
+        (void)std::initializer_list<int>{
+            (vf = svadd_f32_x(pg, vf, calc_chn<S>(pg, tscale, tscale_2, params[K])), 0)...};
+        return vf;
+    }
+    template<int S = step_size>
+    static inline __attribute__((target("+sve")))
+    svfloat32_t sum_chns(svbool_t pg, svfloat32_t tscale, svfloat32_t tscale_2,
+                         int nchns, const channel_param_groups *groups)
+    {
+        auto ps = groups->params;
+        auto vf = svdup_n_f32(0);
+        for (int c = 0; c < groups->nfixed; c++)
+            vf = svadd_f32_x(pg, vf,
+                             calc_chn<S, false, false>(pg, tscale, tscale_2, ps[c]));
+        for (int c = groups->nfixed; c < groups->nfreq; c++)
+            vf = svadd_f32_x(pg, vf,
+                             calc_chn<S, true, false>(pg, tscale, tscale_2, ps[c]));
+        for (int c = groups->nfreq; c < groups->namp; c++)
+            vf = svadd_f32_x(pg, vf,
+                             calc_chn<S, false, true>(pg, tscale, tscale_2, ps[c]));
+        for (int c = groups->namp; c < nchns; c++)
+            vf = svadd_f32_x(pg, vf, calc_chn<S>(pg, tscale, tscale_2, ps[c]));
+        return vf;
+    }
+    template<int nout, int S = step_size, typename P, typename NC>
+    static inline __attribute__((target("+sve")))
+    void calc_wave_multi(int16_t *OUT_ATTR output, NC nchns,
+                         const P *const *PARAM_ATTR params)
+    {
+        for (int i = 0; i < S; i += int(svcntw())) {
+            auto pg = svwhilelt_b32(i, S);
+            svfloat32_t tscale, tscale_2;
+            sve::time_scale<S>(pg, i, tscale, tscale_2);
+            for (int o = 0; o < nout; o++) {
+                auto vf = sum_chns<S>(pg, tscale, tscale_2, nchns[o], params[o]);
+                sve::store_interleave(pg, &output[i * nout], o, nout, vf);
+            }
+        }
+    }
+};
+using SVEGen = SVEGenT<>;
+template<Precision prec>
+struct Runner<SVEGenT<prec>> {
+    template<int S = step_size, typename T>
+    static void __attribute__((target("+sve"), flatten))
+    run_wave_fixed(T *data, size_t sz, size_t rep, int nchn,
+                   const channel_param_fixed *params_fixed)
+    {
+        _run_wave_fixed<SVEGenT<prec>, S>(data, sz, rep, nchn, params_fixed);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("+sve"), flatten))
+    run_wave(T *data, size_t sz, size_t rep, int nchn, const channel_param *params)
+    {
+        _run_wave<SVEGenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int S = step_size, typename T>
+    static void __attribute__((target("+sve"), flatten))
+    run_wave_packed(T *data, size_t sz, size_t rep, int nchn,
+                    const channel_param_packed *params)
+    {
+        _run_wave_packed<SVEGenT<prec>, S>(data, sz, rep, nchn, params);
+    }
+    template<int nout, int S = step_size, typename P>
+    static void __attribute__((target("+sve"), flatten))
+    run_wave_multi(int16_t *data, size_t sz, size_t rep, const int *nchns,
+                   const P *const *params)
+    {
+        _run_wave_multi<SVEGenT<prec>, nout, S>(data, sz, rep, nchns, params);
+    }
+    template<int nout, int S = step_size>
+    static void __attribute__((target("+sve"), flatten))
+    run_wave_steps(int16_t *data, size_t nsteps, const int *nchns,
+                   channel_param_fixed *const *params, const uint32_t *const *phase,
+                   const uint32_t *const *dphase)
+    {
+        _run_wave_steps<SVEGenT<prec>, nout, S>(data, nsteps, nchns, params, phase, dphase);
+    }
+    // Single output channel with `N` tones (`nchns[0] == N`).
+    template<int N, int S = step_size>
+    static void __attribute__((target("+sve"), flatten))
+    run_wave_steps_ntones(int16_t *data, size_t nsteps, const int*,
+                          channel_param_fixed *const *params, const uint32_t *const *phase,
+                          const uint32_t *const *dphase)
+    {
+        _run_wave_steps<SVEGenT<prec>, 1, S>(data, nsteps, nchns_t<N>(), params,
+                                             phase, dphase);
+    }
+};
+#endif
 #endif
 
 }
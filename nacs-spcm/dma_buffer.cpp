@@ -0,0 +1,171 @@
+/*************************************************************************
+ *   Copyright (c) 2019 - 2019 Yichao Yu <yyc1992@gmail.com>             *
+ *                                                                       *
+ *   This library is free software; you can redistribute it and/or       *
+ *   modify it under the terms of the GNU Lesser General Public          *
+ *   License as published by the Free Software Foundation; either        *
+ *   version 3.0 of the License, or (at your option) any later version.  *
+ *                                                                       *
+ *   This library is distributed in the hope that it will be useful,     *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU    *
+ *   Lesser General Public License for more details.                     *
+ *                                                                       *
+ *   You should have received a copy of the GNU Lesser General Public    *
+ *   License along with this library. If not,                            *
+ *   see <http://www.gnu.org/licenses/>.                                 *
+ *************************************************************************/
+
+#include "dma_buffer.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace NaCs {
+namespace Spcm {
+
+namespace {
+
+constexpr size_t page_size = 4096;
+constexpr size_t hugepage_size = 2 * 1024 * 1024;
+
+static size_t align_up(size_t sz, size_t align)
+{
+    return (sz + align - 1) / align * align;
+}
+
+// Use the syscall directly instead of depending on libnuma just for this.
+// Called before any of the pages are allocated so that they are allocated on the node
+// from the start instead of being migrated, which can fail for huge pages.
+static bool bind_node(void *data, size_t size, int node)
+{
+    constexpr int mpol_bind = 2;
+    constexpr int nbits = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> mask(node / nbits + 1, 0);
+    mask[node / nbits] = 1ul << (node % nbits);
+    return syscall(SYS_mbind, data, size, mpol_bind, mask.data(),
+                   mask.size() * nbits + 1, 0) == 0;
+}
+
+// Allocate all the huge pages of the mapping (i.e. `MAP_POPULATE` after the memory policy
+// is set). Returns `false` if there aren't enough free pages.
+static bool populate_hugetlb(void *data, size_t size, bool bound)
+{
+    // `MADV_POPULATE_WRITE`, which may not be in the headers.
+    constexpr int madv_populate_write = 23;
+    if (madvise(data, size, madv_populate_write) == 0)
+        return true;
+    // Not supported before Linux 5.14. Touching the pages is only safe without
+    // the memory policy since the pages are then guaranteed by the reservation done by
+    // `mmap`, otherwise a page that can't be allocated on the node raises `SIGBUS`.
+    if (errno != EINVAL || bound)
+        return false;
+    for (size_t offset = 0; offset < size; offset += hugepage_size)
+        static_cast<volatile char*>(data)[offset] = 0;
+    return true;
+}
+
+}
+
+NACS_EXPORT() DMABuffer::DMABuffer(Spcm &card, size_t size, uint32_t notify_size,
+                                   bool hugepage, int numa_node)
+    : m_card(card),
+      m_data(nullptr),
+      m_size(size),
+      m_map_size(0),
+      m_notify_size(notify_size),
+      m_hugepage(false)
+{
+    if (notify_size == 0 || notify_size % page_size != 0 || size == 0 ||
+        size % notify_size != 0)
+        throw std::invalid_argument("DMABuffer: invalid buffer size");
+    if (hugepage) {
+        m_map_size = align_up(size, hugepage_size);
+        // Populated after the NUMA node is set.
+        m_data = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (m_data != MAP_FAILED) {
+            if (numa_node >= 0 && !bind_node(m_data, m_map_size, numa_node)) {
+                munmap(m_data, m_map_size);
+                throw std::invalid_argument("DMABuffer: cannot allocate on NUMA node");
+            }
+            if (populate_hugetlb(m_data, m_map_size, numa_node >= 0)) {
+                m_hugepage = true;
+            }
+            else {
+                // Not enough huge pages (on the node) or they can't be allocated safely,
+                // use the normal pages (and the transparent huge pages) instead.
+                munmap(m_data, m_map_size);
+            }
+        }
+    }
+    if (!m_hugepage) {
+        m_map_size = align_up(size, page_size);
+        m_data = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_data == MAP_FAILED)
+            throw std::bad_alloc();
+        // Fallback to transparent huge page, ignore the error if that's not supported.
+        if (hugepage) {
+            madvise(m_data, m_map_size, MADV_HUGEPAGE);
+        }
+        // The pages are allocated when the buffer is locked for the DMA.
+        if (numa_node >= 0 && !bind_node(m_data, m_map_size, numa_node)) {
+            munmap(m_data, m_map_size);
+            throw std::invalid_argument("DMABuffer: cannot allocate on NUMA node");
+        }
+    }
+    if (m_card.def_transfer(SPCM_BUF_DATA, SPCM_DIR_PCTOCARD, notify_size,
+                            m_data, 0, size)) {
+        munmap(m_data, m_map_size);
+        m_card.throw_error();
+    }
+}
+
+NACS_EXPORT() DMABuffer::~DMABuffer()
+{
+    m_card.invalidate_buf(SPCM_BUF_DATA);
+    munmap(m_data, m_map_size);
+}
+
+NACS_EXPORT() DMABuffer::Span DMABuffer::get_span()
+{
+    uint64_t pos;
+    uint64_t len;
+    if (m_card.get_param(SPC_DATA_AVAIL_USER_POS, &pos) ||
+        m_card.get_param(SPC_DATA_AVAIL_USER_LEN, &len))
+        m_card.throw_error();
+    return {(char*)m_data + pos, std::min<size_t>(len, m_size - pos)};
+}
+
+NACS_EXPORT() DMABuffer::Span DMABuffer::wait_span(size_t min_size)
+{
+    while (true) {
+        auto span = get_span();
+        if (span.size >= min_size)
+            return span;
+        // The span is limited by the end of the buffer and cannot grow anymore.
+        if (span.size && (char*)span.data + span.size == (char*)m_data + m_size)
+            return span;
+        if (m_card.set_param(SPC_M2CMD, M2CMD_DATA_WAITDMA)) {
+            m_card.throw_error();
+        }
+    }
+}
+
+NACS_EXPORT() void DMABuffer::commit(size_t size)
+{
+    if (m_card.set_param(SPC_DATA_AVAIL_CARD_LEN, uint64_t(size))) {
+        m_card.throw_error();
+    }
+}
+
+}
+}
@@ -0,0 +1,93 @@
+/*************************************************************************
+ *   Copyright (c) 2019 - 2019 Yichao Yu <yyc1992@gmail.com>             *
+ *                                                                       *
+ *   This library is free software; you can redistribute it and/or       *
+ *   modify it under the terms of the GNU Lesser General Public          *
+ *   License as published by the Free Software Foundation; either        *
+ *   version 3.0 of the License, or (at your option) any later version.  *
+ *                                                                       *
+ *   This library is distributed in the hope that it will be useful,     *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU    *
+ *   Lesser General Public License for more details.                     *
+ *                                                                       *
+ *   You should have received a copy of the GNU Lesser General Public    *
+ *   License along with this library. If not,                            *
+ *   see <http://www.gnu.org/licenses/>.                                 *
+ *************************************************************************/
+
+#ifndef _NACS_SPCM_DMA_BUFFER_H
+#define _NACS_SPCM_DMA_BUFFER_H
+
+#include "spcm.h"
+
+namespace NaCs {
+namespace Spcm {
+
+// The data buffer used for the FIFO mode of the card.
+// The memory is allocated and registered as the `SPCM_BUF_DATA` buffer
+// on construction and the writable part of it is returned as spans
+// that can be filled directly without any additional copy.
+// All sizes are in bytes.
+class DMABuffer {
+public:
+    struct Span {
+        void *data;
+        size_t size;
+    };
+
+    // `notify_size` must be a multiple of 4096 and `size` a multiple of `notify_size`.
+    // Huge pages are used if requested and available, otherwise transparent huge pages
+    // are requested for the buffer instead.
+    // If `numa_node` is not negative, the memory is allocated on that node,
+    // which should be the one the card is attached to
+    // (i.e. `/sys/bus/pci/devices/<address of the card>/numa_node`).
+    DMABuffer(Spcm &card, size_t size, uint32_t notify_size, bool hugepage=false,
+              int numa_node=-1);
+    DMABuffer(const DMABuffer&) = delete;
+    DMABuffer &operator=(const DMABuffer&) = delete;
+    // The DMA must be stopped before the buffer is freed.
+    ~DMABuffer();
+
+    void *data() const
+    {
+        return m_data;
+    }
+    size_t size() const
+    {
+        return m_size;
+    }
+    uint32_t notify_size() const
+    {
+        return m_notify_size;
+    }
+    // Whether the buffer is backed by explicitly allocated huge pages.
+    bool hugepage() const
+    {
+        return m_hugepage;
+    }
+
+    // The region that can be written to by the user.
+    // The span never wraps around the end of the buffer so it may be shorter
+    // than the total available space, in which case the rest is available
+    // from the start of the buffer after the span is committed.
+    Span get_span();
+    // Same as `get_span` but wait for the card until at least `min_size` bytes is available
+    // or the span reaches the end of the buffer.
+    Span wait_span(size_t min_size);
+    // Hand over the first `size` bytes of the span to the card.
+    void commit(size_t size);
+
+private:
+    Spcm &m_card;
+    void *m_data;
+    size_t m_size;
+    size_t m_map_size;
+    uint32_t m_notify_size;
+    bool m_hugepage;
+};
+
+}
+}
+
+#endif
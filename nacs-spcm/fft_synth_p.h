@@ -0,0 +1,237 @@
+/*************************************************************************
+ *   Copyright (c) 2019 - 2019 Yichao Yu <yyc1992@gmail.com>             *
+ *                                                                       *
+ *   This library is free software; you can redistribute it and/or       *
+ *   modify it under the terms of the GNU Lesser General Public          *
+ *   License as published by the Free Software Foundation; either        *
+ *   version 3.0 of the License, or (at your option) any later version.  *
+ *                                                                       *
+ *   This library is distributed in the hope that it will be useful,     *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU    *
+ *   Lesser General Public License for more details.                     *
+ *                                                                       *
+ *   You should have received a copy of the GNU Lesser General Public    *
+ *   License along with this library. If not,                            *
+ *   see <http://www.gnu.org/licenses/>.                                 *
+ *************************************************************************/
+
+#ifndef _NACS_SPCM_FFT_SYNTH_P_H
+#define _NACS_SPCM_FFT_SYNTH_P_H
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace NaCs {
+namespace Spcm {
+
+// Compute the sum of many constant tones one block of `block_size` samples at a time
+// with an inverse FFT instead of evaluating every tone at every sample.
+//
+// The tone frequencies are not restricted to the FFT bins.
+// Each tone is spread onto an oversampled frequency grid with a smooth kernel
+// (the "exponential of semicircle" kernel of FINUFFT), the grid is transformed
+// back to the time domain and the effect of the kernel is divided out
+// (i.e. a type 1 non-uniform FFT).
+// The error is about `1e-6` of the total amplitude, limited by the single precision FFT.
+// Since every block is computed from the exact phase of the tones at its start,
+// there's no windowing or overlap between the blocks and the output is phase continuous.
+//
+// The cost for each block is a constant for the FFT and
+// a few operations for each tone instead of `block_size` sine evaluations.
+class FFTSynth {
+public:
+    static constexpr int block_size = 1024;
+
+    struct Tone {
+        double phase; // In unit of cycles
+        double freq; // In unit of cycles per sample, in `[-0.5, 0.5)`
+        double amp;
+    };
+
+    FFTSynth()
+        : m_plan(get_plan())
+    {
+    }
+
+    // Write `sum(amp * sin(2pi * (phase + freq * i)))` for `i` in `[0, block_size)`
+    // to `out`.
+    // The spreading weights of each tone are cached by the index of the tone
+    // so it's cheaper to keep the same order of the tones between the calls.
+    void run(float *out, const Tone *tones, int ntones)
+    {
+        auto &plan = *m_plan;
+        if (m_cache.size() < size_t(ntones))
+            m_cache.resize(ntones);
+        for (int i = 0; i < grid_size; i++) {
+            m_re[i] = 0;
+            m_im[i] = 0;
+        }
+        for (int k = 0; k < ntones; k++) {
+            auto &tone = tones[k];
+            auto &cache = m_cache[k];
+            if (!cache.valid || cache.freq != tone.freq)
+                cache.compute(tone.freq);
+            // Shift the time origin to the center of the block
+            // so that the output covers the lower half of the frequencies of the grid.
+            double phase = tone.phase + tone.freq * (block_size / 2);
+            phase = (phase - std::floor(phase)) * (2 * M_PI);
+            auto re = float(std::cos(phase) * tone.amp);
+            auto im = float(std::sin(phase) * tone.amp);
+            for (int j = 0; j < kernel_width; j++) {
+                auto idx = plan.rev[(cache.start + j) & (grid_size - 1)];
+                m_re[idx] += re * cache.weights[j];
+                m_im[idx] += im * cache.weights[j];
+            }
+        }
+        plan.inverse_fft(m_re.get(), m_im.get());
+        for (int i = 0; i < block_size; i++) {
+            int n = i - block_size / 2;
+            out[i] = m_im[n & (grid_size - 1)] * plan.correction[std::abs(n)];
+        }
+    }
+
+private:
+    // The frequency grid is oversampled by a factor of 2.
+    static constexpr int grid_size = block_size * 2;
+    static constexpr int grid_bits = 11;
+    static_assert((1 << grid_bits) == grid_size, "");
+    static constexpr int kernel_width = 8;
+    // In unit of grid points.
+    static constexpr double kernel_beta = 2.3 * kernel_width;
+
+    // The kernel, `t` is the distance from the center in unit of grid points.
+    static double kernel(double t)
+    {
+        auto z = 2 * t / kernel_width;
+        if (std::abs(z) >= 1)
+            return 0;
+        return std::exp(kernel_beta * (std::sqrt(1 - z * z) - 1));
+    }
+
+    // Tables shared by all the synthesizers.
+    struct Plan {
+        Plan()
+            : rev(new int[grid_size]),
+              cos_tbl(new float[grid_size - 1]),
+              sin_tbl(new float[grid_size - 1]),
+              correction(new float[block_size / 2 + 1])
+        {
+            for (int i = 0; i < grid_size; i++) {
+                int r = 0;
+                for (int b = 0; b < grid_bits; b++)
+                    r |= ((i >> b) & 1) << (grid_bits - 1 - b);
+                rev[i] = r;
+            }
+            // The twiddle factors for the stage with `h` butterflies per group
+            // are stored starting at `h - 1`.
+            for (int h = 1; h < grid_size; h *= 2) {
+                for (int j = 0; j < h; j++) {
+                    auto theta = M_PI * j / h;
+                    cos_tbl[h - 1 + j] = float(std::cos(theta));
+                    sin_tbl[h - 1 + j] = float(std::sin(theta));
+                }
+            }
+            // The Fourier transform of the kernel, computed with the midpoint rule
+            // which converges quickly since the kernel is smooth and
+            // almost zero at the edges.
+            constexpr int nquad = 64 * kernel_width;
+            constexpr double dt = double(kernel_width) / nquad;
+            std::vector<double> kernel_tbl(nquad);
+            for (int q = 0; q < nquad; q++)
+                kernel_tbl[q] = kernel((q + 0.5) * dt - kernel_width / 2.0);
+            for (int n = 0; n <= block_size / 2; n++) {
+                double sum = 0;
+                for (int q = 0; q < nquad; q++) {
+                    auto t = (q + 0.5) * dt - kernel_width / 2.0;
+                    sum += kernel_tbl[q] * std::cos(2 * M_PI * n * t / grid_size);
+                }
+                correction[n] = float(1 / (sum * dt));
+            }
+        }
+
+        // Unnormalized in place inverse FFT of the bit reversed input.
+        void inverse_fft(float *re, float *im) const
+        {
+            // The first two stages don't need any multiplication.
+            for (int g = 0; g < grid_size; g += 4) {
+                auto ar = re[g] + re[g + 1];
+                auto ai = im[g] + im[g + 1];
+                auto br = re[g] - re[g + 1];
+                auto bi = im[g] - im[g + 1];
+                auto cr = re[g + 2] + re[g + 3];
+                auto ci = im[g + 2] + im[g + 3];
+                // Multiplied by `i`.
+                auto dr = im[g + 3] - im[g + 2];
+                auto di = re[g + 2] - re[g + 3];
+                re[g] = ar + cr;
+                im[g] = ai + ci;
+                re[g + 1] = br + dr;
+                im[g + 1] = bi + di;
+                re[g + 2] = ar - cr;
+                im[g + 2] = ai - ci;
+                re[g + 3] = br - dr;
+                im[g + 3] = bi - di;
+            }
+            for (int h = 4; h < grid_size; h *= 2) {
+                auto wr = &cos_tbl[h - 1];
+                auto wi = &sin_tbl[h - 1];
+                for (int g = 0; g < grid_size; g += 2 * h) {
+                    auto re0 = &re[g];
+                    auto im0 = &im[g];
+                    auto re1 = &re[g + h];
+                    auto im1 = &im[g + h];
+                    for (int j = 0; j < h; j++) {
+                        auto tr = re1[j] * wr[j] - im1[j] * wi[j];
+                        auto ti = re1[j] * wi[j] + im1[j] * wr[j];
+                        re1[j] = re0[j] - tr;
+                        im1[j] = im0[j] - ti;
+                        re0[j] += tr;
+                        im0[j] += ti;
+                    }
+                }
+            }
+        }
+
+        std::unique_ptr<int[]> rev;
+        std::unique_ptr<float[]> cos_tbl;
+        std::unique_ptr<float[]> sin_tbl;
+        // `1 / (Fourier transform of the kernel)` for each output time,
+        // relative to the center of the block.
+        std::unique_ptr<float[]> correction;
+    };
+    static const Plan *get_plan()
+    {
+        static const Plan plan;
+        return &plan;
+    }
+
+    // The grid points covered by a tone and the kernel values on them.
+    struct ToneCache {
+        double freq;
+        int start;
+        bool valid = false;
+        float weights[kernel_width];
+        void compute(double _freq)
+        {
+            freq = _freq;
+            valid = true;
+            auto center = freq * grid_size;
+            start = int(std::ceil(center - kernel_width / 2.0));
+            for (int j = 0; j < kernel_width; j++) {
+                weights[j] = float(kernel(center - (start + j)));
+            }
+        }
+    };
+
+    const Plan *m_plan;
+    std::unique_ptr<float[]> m_re{new float[grid_size]};
+    std::unique_ptr<float[]> m_im{new float[grid_size]};
+    std::vector<ToneCache> m_cache;
+};
+
+}
+}
+
+#endif
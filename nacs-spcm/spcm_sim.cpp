@@ -0,0 +1,403 @@
+/*************************************************************************
+ *   Copyright (c) 2019 - 2019 Yichao Yu <yyc1992@gmail.com>             *
+ *                                                                       *
+ *   This library is free software; you can redistribute it and/or       *
+ *   modify it under the terms of the GNU Lesser General Public          *
+ *   License as published by the Free Software Foundation; either        *
+ *   version 3.0 of the License, or (at your option) any later version.  *
+ *                                                                       *
+ *   This library is distributed in the hope that it will be useful,     *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU    *
+ *   Lesser General Public License for more details.                     *
+ *                                                                       *
+ *   You should have received a copy of the GNU Lesser General Public    *
+ *   License along with this library. If not,                            *
+ *   see <http://www.gnu.org/licenses/>.                                 *
+ *************************************************************************/
+
+#include "spcm_sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace NaCs {
+namespace Spcm {
+namespace Sim {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// Roughly what a PCIe x8 Gen2 card can sustain.
+constexpr double default_dma_rate = 3.4e9;
+// The on board memory of the M4i.6622-x8, all of which is used as the FIFO.
+constexpr double default_mem_size = 4ll * 1024 * 1024 * 1024;
+
+static double get_env(const char *name, double def)
+{
+    if (auto env = getenv(name)) {
+        auto val = strtod(env, nullptr);
+        if (val > 0) {
+            return val;
+        }
+    }
+    return def;
+}
+
+struct Card {
+    Card()
+        : dma_rate(get_env("NACS_SPCM_SIM_DMA_RATE", default_dma_rate)),
+          mem_size(int64_t(get_env("NACS_SPCM_SIM_MEM_SIZE", default_mem_size)))
+    {
+        reset();
+    }
+
+    std::mutex lock;
+    std::map<int32_t,int64_t> regs;
+    const double dma_rate;
+    const int64_t mem_size;
+
+    uint32_t err;
+    uint32_t err_reg;
+    int32_t err_val;
+    std::string err_msg;
+
+    char *buff = nullptr;
+    uint64_t buff_size = 0;
+    uint32_t notify_size = 0;
+
+    // All in bytes since the buffer is defined.
+    uint64_t committed; // Written by the user.
+    double transferred; // Moved to the on board memory.
+    double consumed; // Output by the card.
+
+    bool dma_running;
+    bool card_running;
+    bool underrun;
+    clock::time_point last_update;
+
+    Stats stats;
+
+    void reset()
+    {
+        regs.clear();
+        regs[SPC_PCITYP] = TYP_M4I6622_X8;
+        regs[SPC_PCISAMPLERATE] = 625000000;
+        regs[SPC_PCIMEMSIZE] = mem_size;
+        regs[SPC_SAMPLERATE] = 625000000;
+        regs[SPC_CHENABLE] = 1;
+        regs[SPC_TIMEOUT] = 0;
+        err = ERR_OK;
+        err_reg = 0;
+        err_val = 0;
+        err_msg.clear();
+        reset_fifo();
+    }
+    void reset_fifo()
+    {
+        committed = 0;
+        transferred = 0;
+        consumed = 0;
+        dma_running = false;
+        card_running = false;
+        underrun = false;
+        last_update = clock::now();
+        stats = {0, 0, INFINITY};
+    }
+    uint32_t set_error(uint32_t code, int32_t reg, int64_t val, const char *msg)
+    {
+        err = code;
+        err_reg = reg;
+        err_val = int32_t(val);
+        err_msg = msg;
+        return code;
+    }
+    int nchns()
+    {
+        return __builtin_popcountll(regs[SPC_CHENABLE]);
+    }
+    double byte_rate()
+    {
+        return double(regs[SPC_SAMPLERATE]) * nchns() * 2;
+    }
+    uint64_t freed()
+    {
+        if (!notify_size)
+            return 0;
+        return uint64_t(transferred) / notify_size * notify_size;
+    }
+    uint64_t user_len()
+    {
+        return buff_size - (committed - freed());
+    }
+    void update(clock::time_point now)
+    {
+        double dt = std::chrono::duration<double>(now - last_update).count();
+        last_update = now;
+        double out = consumed;
+        if (card_running)
+            out += byte_rate() * dt;
+        if (dma_running) {
+            // Both the output and the transfer are linear in time so checking
+            // for underrun at the end of the interval is enough.
+            auto avail = std::min(double(committed), out + double(regs[SPC_PCIMEMSIZE]));
+            transferred = std::min(avail, transferred + dma_rate * dt);
+        }
+        if (!card_running)
+            return;
+        if (out > transferred) {
+            out = transferred;
+            card_running = false;
+            underrun = true;
+            stats.underruns++;
+        }
+        consumed = out;
+        stats.consumed = uint64_t(consumed);
+    }
+    uint32_t get_reg(int32_t reg, int64_t *val)
+    {
+        update(clock::now());
+        switch (reg) {
+        case SPC_CHCOUNT:
+            *val = nchns();
+            break;
+        case SPC_DATA_AVAIL_USER_LEN:
+            *val = int64_t(user_len());
+            break;
+        case SPC_DATA_AVAIL_USER_POS:
+            *val = buff_size ? int64_t(committed % buff_size) : 0;
+            break;
+        case SPC_M2STATUS:
+            *val = 0;
+            if (!card_running)
+                *val |= M2STAT_CARD_READY;
+            if (notify_size && user_len() >= notify_size)
+                *val |= M2STAT_DATA_BLOCKREADY;
+            if (underrun)
+                *val |= M2STAT_DATA_OVERRUN;
+            break;
+        default: {
+            auto it = regs.find(reg);
+            *val = it == regs.end() ? 0 : it->second;
+        }
+        }
+        return ERR_OK;
+    }
+    uint32_t underrun_error()
+    {
+        return set_error(ERR_FIFOHWOVERRUN, SPC_M2STATUS, 0, "Simulated card: output underrun");
+    }
+    uint32_t commit(int64_t len)
+    {
+        if (underrun)
+            return underrun_error();
+        if (!buff)
+            return set_error(ERR_SEQUENCE, SPC_DATA_AVAIL_CARD_LEN, len,
+                             "Simulated card: no buffer defined");
+        if (len < 0 || uint64_t(len) > user_len())
+            return set_error(ERR_VALUE, SPC_DATA_AVAIL_CARD_LEN, len,
+                             "Simulated card: not enough space available");
+        if (card_running)
+            stats.min_lead = std::min(stats.min_lead,
+                                      (double(committed) - consumed) / byte_rate());
+        committed += uint64_t(len);
+        return ERR_OK;
+    }
+    uint32_t wait_dma(std::unique_lock<std::mutex> &locker)
+    {
+        if (!dma_running)
+            return set_error(ERR_SEQUENCE, SPC_M2CMD, M2CMD_DATA_WAITDMA,
+                             "Simulated card: DMA not started");
+        auto start = last_update;
+        auto timeout = std::chrono::milliseconds(regs[SPC_TIMEOUT]);
+        auto target = freed() + notify_size;
+        while (freed() < target) {
+            if (underrun)
+                return underrun_error();
+            if (timeout.count() && last_update - start >= timeout)
+                return set_error(ERR_TIMEOUT, SPC_M2CMD, M2CMD_DATA_WAITDMA,
+                                 "Simulated card: timeout");
+            // Estimate the time it takes to free up the block.
+            double rate = dma_rate;
+            if (transferred >= consumed + double(regs[SPC_PCIMEMSIZE]))
+                rate = card_running ? byte_rate() : 0;
+            double wait = rate ? (double(target) - transferred) / rate : 1e-3;
+            wait = std::max(std::min(wait, 1e-3), 1e-6);
+            locker.unlock();
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            locker.lock();
+            update(clock::now());
+        }
+        return ERR_OK;
+    }
+    uint32_t command(int64_t cmd, std::unique_lock<std::mutex> &locker)
+    {
+        if (cmd & M2CMD_CARD_RESET) {
+            reset();
+            return ERR_OK;
+        }
+        if (cmd & M2CMD_CARD_STOP)
+            card_running = false;
+        if (cmd & M2CMD_DATA_STOPDMA)
+            dma_running = false;
+        if (cmd & M2CMD_DATA_STARTDMA) {
+            if (!buff)
+                return set_error(ERR_SEQUENCE, SPC_M2CMD, cmd,
+                                 "Simulated card: no buffer defined");
+            dma_running = true;
+        }
+        if (cmd & M2CMD_CARD_START) {
+            card_running = true;
+            underrun = false;
+        }
+        if (cmd & M2CMD_DATA_WAITDMA)
+            return wait_dma(locker);
+        return ERR_OK;
+    }
+    uint32_t set_reg(int32_t reg, int64_t val, std::unique_lock<std::mutex> &locker)
+    {
+        update(clock::now());
+        switch (reg) {
+        case SPC_M2CMD:
+            return command(val, locker);
+        case SPC_DATA_AVAIL_CARD_LEN:
+            return commit(val);
+        default:
+            regs[reg] = val;
+            return ERR_OK;
+        }
+    }
+    uint32_t def_transfer(uint32_t type, uint32_t notify, void *data, uint64_t size)
+    {
+        if (type != SPCM_BUF_DATA)
+            return set_error(ERR_NOTIMPLEMENTED, 0, type,
+                             "Simulated card: buffer type not supported");
+        if (dma_running)
+            return set_error(ERR_SEQUENCE, 0, 0, "Simulated card: DMA running");
+        if (!data || !size || !notify || size % notify)
+            return set_error(ERR_VALUE, 0, 0, "Simulated card: invalid buffer");
+        buff = (char*)data;
+        buff_size = size;
+        notify_size = notify;
+        reset_fifo();
+        return ERR_OK;
+    }
+};
+
+static Card *get_card(drv_handle hdl)
+{
+    return (Card*)hdl;
+}
+
+}
+
+NACS_EXPORT() Stats get_stats(drv_handle hdl)
+{
+    auto card = get_card(hdl);
+    std::lock_guard<std::mutex> locker(card->lock);
+    card->update(clock::now());
+    return card->stats;
+}
+
+}
+}
+}
+
+using namespace NaCs::Spcm::Sim;
+
+extern "C" {
+
+NACS_EXPORT() drv_handle _stdcall spcm_hOpen(const char*)
+{
+    return (drv_handle)new Card;
+}
+
+NACS_EXPORT() void _stdcall spcm_vClose(drv_handle hdl)
+{
+    delete get_card(hdl);
+}
+
+NACS_EXPORT() uint32 _stdcall spcm_dwGetErrorInfo_i32(drv_handle hdl, uint32 *reg,
+                                                      int32 *val, char *msg)
+{
+    auto card = get_card(hdl);
+    std::lock_guard<std::mutex> locker(card->lock);
+    auto code = card->err;
+    if (reg)
+        *reg = card->err_reg;
+    if (val)
+        *val = card->err_val;
+    if (msg) {
+        strncpy(msg, card->err_msg.c_str(), ERRORTEXTLEN - 1);
+        msg[ERRORTEXTLEN - 1] = 0;
+    }
+    card->err = ERR_OK;
+    card->err_reg = 0;
+    card->err_val = 0;
+    card->err_msg.clear();
+    return code;
+}
+
+NACS_EXPORT() uint32 _stdcall spcm_dwSetParam_i64(drv_handle hdl, int32 reg, int64 val)
+{
+    auto card = get_card(hdl);
+    std::unique_lock<std::mutex> locker(card->lock);
+    return card->set_reg(reg, val, locker);
+}
+
+NACS_EXPORT() uint32 _stdcall spcm_dwSetParam_i32(drv_handle hdl, int32 reg, int32 val)
+{
+    return spcm_dwSetParam_i64(hdl, reg, val);
+}
+
+NACS_EXPORT() uint32 _stdcall spcm_dwGetParam_i64(drv_handle hdl, int32 reg, int64 *val)
+{
+    auto card = get_card(hdl);
+    std::lock_guard<std::mutex> locker(card->lock);
+    return card->get_reg(reg, val);
+}
+
+NACS_EXPORT() uint32 _stdcall spcm_dwGetParam_i32(drv_handle hdl, int32 reg, int32 *val)
+{
+    int64 val64;
+    auto err = spcm_dwGetParam_i64(hdl, reg, &val64);
+    *val = int32(val64);
+    return err;
+}
+
+NACS_EXPORT() uint32 _stdcall spcm_dwDefTransfer_i64(drv_handle hdl, uint32 type, uint32 dir,
+                                                     uint32 notify, void *data, uint64 offset,
+                                                     uint64 size)
+{
+    auto card = get_card(hdl);
+    std::lock_guard<std::mutex> locker(card->lock);
+    if (dir != SPCM_DIR_PCTOCARD || offset != 0)
+        return card->set_error(ERR_NOTIMPLEMENTED, 0, 0,
+                               "Simulated card: only replay is supported");
+    return card->def_transfer(type, notify, data, size);
+}
+
+NACS_EXPORT() uint32 _stdcall spcm_dwInvalidateBuf(drv_handle hdl, uint32 type)
+{
+    auto card = get_card(hdl);
+    std::lock_guard<std::mutex> locker(card->lock);
+    if (type != SPCM_BUF_DATA)
+        return card->set_error(ERR_NOTIMPLEMENTED, 0, type,
+                               "Simulated card: buffer type not supported");
+    card->buff = nullptr;
+    card->buff_size = 0;
+    card->notify_size = 0;
+    card->reset_fifo();
+    return ERR_OK;
+}
+
+}
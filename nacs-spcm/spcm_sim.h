@@ -0,0 +1,60 @@
+/*************************************************************************
+ *   Copyright (c) 2019 - 2019 Yichao Yu <yyc1992@gmail.com>             *
+ *                                                                       *
+ *   This library is free software; you can redistribute it and/or       *
+ *   modify it under the terms of the GNU Lesser General Public          *
+ *   License as published by the Free Software Foundation; either        *
+ *   version 3.0 of the License, or (at your option) any later version.  *
+ *                                                                       *
+ *   This library is distributed in the hope that it will be useful,     *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU    *
+ *   Lesser General Public License for more details.                     *
+ *                                                                       *
+ *   You should have received a copy of the GNU Lesser General Public    *
+ *   License along with this library. If not,                            *
+ *   see <http://www.gnu.org/licenses/>.                                 *
+ *************************************************************************/
+
+#ifndef _NACS_SPCM_SPCM_SIM_H
+#define _NACS_SPCM_SPCM_SIM_H
+
+#include "spcm.h"
+
+// `libnacs-spcm-sim` implements the `spcm_*` driver functions used by `libnacs-spcm`
+// with a simulated card in FIFO replay mode.
+// Linking it before `libnacs-spcm` replaces the real driver, i.e. every device name
+// opens a new simulated card.
+//
+// The card consumes the data at `SPC_SAMPLERATE` for each of the channels enabled in
+// `SPC_CHENABLE` after `M2CMD_CARD_START` (the trigger is assumed to be immediate).
+// Data are moved from the DMA buffer to the on board memory (`SPC_PCIMEMSIZE`)
+// at the PCIe rate, which can be overwritten with the `NACS_SPCM_SIM_DMA_RATE`
+// environment variable (in bytes per second).
+// The on board memory is 4GB, which can be overwritten with the
+// `NACS_SPCM_SIM_MEM_SIZE` environment variable (in bytes) or by setting the register.
+// It buffers several seconds of output at the lower sample rates so a short test
+// should use a smaller one for the underruns to be possible.
+// Like the real card, the output stops and `ERR_FIFOHWOVERRUN` is reported
+// if the card runs out of data.
+// All registers, including read-only ones, can be written to.
+
+namespace NaCs {
+namespace Spcm {
+namespace Sim {
+
+struct Stats {
+    uint64_t consumed; // Bytes of data output by the card.
+    uint64_t underruns;
+    // The minimum amount of data (in seconds) buffered ahead of the output
+    // when new data is committed while the card is running.
+    double min_lead;
+};
+
+NACS_EXPORT(spcm) Stats get_stats(drv_handle hdl);
+
+}
+}
+}
+
+#endif
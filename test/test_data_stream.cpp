@@ -0,0 +1,553 @@
+/*************************************************************************
+ *   Copyright (c) 2019 - 2019 Yichao Yu <yyc1992@gmail.com>             *
+ *                                                                       *
+ *   This library is free software; you can redistribute it and/or       *
+ *   modify it under the terms of the GNU Lesser General Public          *
+ *   License as published by the Free Software Foundation; either        *
+ *   version 3.0 of the License, or (at your option) any later version.  *
+ *                                                                       *
+ *   This library is distributed in the hope that it will be useful,     *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU    *
+ *   Lesser General Public License for more details.                     *
+ *                                                                       *
+ *   You should have received a copy of the GNU Lesser General Public    *
+ *   License along with this library. If not,                            *
+ *   see <http://www.gnu.org/licenses/>.                                 *
+ *************************************************************************/
+
+#include <nacs-spcm/data_stream.h>
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace NaCs;
+using namespace NaCs::Spcm;
+
+struct RefTone {
+    double phase;
+    double freq;
+    double amp;
+};
+
+// Reference implementation in double precision.
+// Each tone's parameters are the ones set at the step boundary at or before the sample.
+static double ref_sample(const std::vector<RefTone> &tones, uint64_t t0, uint64_t t)
+{
+    double v = 0;
+    for (auto &tone: tones) {
+        auto phase = tone.phase + tone.freq * double(t - t0);
+        v += tone.amp * std::sin(2 * M_PI * phase);
+    }
+    return v * 32767;
+}
+
+static void check_output(const int16_t *data, size_t nsamples, uint64_t t0,
+                         const std::vector<RefTone> &tones, double tol)
+{
+    for (size_t i = 0; i < nsamples; i++) {
+        auto expected = ref_sample(tones, t0, t0 + i);
+        assert(std::abs(expected - data[i]) <= tol);
+    }
+}
+
+static void test_static()
+{
+    DataStream stream(3);
+    std::vector<RefTone> tones{{0.1, 0.01, 0.2}, {0.7, 0.123, 0.3}, {0.3, -0.31, 0.25}};
+    for (uint32_t i = 0; i < tones.size(); i++) {
+        stream.add_cmd({0, i, DataStream::CmdType::Phase, tones[i].phase});
+        stream.add_cmd({0, i, DataStream::CmdType::Freq, tones[i].freq});
+        stream.add_cmd({0, i, DataStream::CmdType::Amp, tones[i].amp});
+    }
+    // Generate in multiple chunks to make sure the phase is continuous across calls.
+    alignas(64) static int16_t data[32 * 1024];
+    for (int i = 0; i < 32; i++)
+        stream.generate(&data[i * 1024], 32);
+    assert(stream.cur_t() == 32 * 1024);
+    check_output(data, 32 * 1024, 0, tones, 3);
+}
+
+static void test_cmd_time()
+{
+    DataStream stream(2);
+    stream.add_cmd({0, 0, DataStream::CmdType::Freq, 0.05});
+    stream.add_cmd({0, 0, DataStream::CmdType::Amp, 0.5});
+    // Takes effect at the next step boundary, i.e. 64.
+    stream.add_cmd({40, 1, DataStream::CmdType::Freq, 0.2});
+    stream.add_cmd({40, 1, DataStream::CmdType::Amp, 0.4});
+    alignas(64) int16_t data[32 * 8];
+    stream.generate(data, 8);
+    check_output(data, 64, 0, {{0, 0.05, 0.5}}, 2);
+    check_output(&data[64], 32 * 8 - 64, 64,
+                 {{0.05 * 64, 0.05, 0.5}, {0, 0.2, 0.4}}, 2);
+
+    // Commands added while streaming.
+    stream.add_cmd({256, 0, DataStream::CmdType::Amp, 0});
+    stream.generate(data, 8);
+    check_output(data, 32 * 8, 256, {{0.2 * 192, 0.2, 0.4}}, 2);
+}
+
+static void test_long_run()
+{
+    DataStream stream(2);
+    std::vector<RefTone> tones{{0.3, 0.1234567, 0.4}, {0.9, -0.3183098, 0.3}};
+    for (uint32_t i = 0; i < tones.size(); i++) {
+        stream.add_cmd({0, i, DataStream::CmdType::Phase, tones[i].phase});
+        stream.add_cmd({0, i, DataStream::CmdType::Freq, tones[i].freq});
+        stream.add_cmd({0, i, DataStream::CmdType::Amp, tones[i].amp});
+    }
+    // 2^30 samples, or ~1.7s at 625MS/s.
+    alignas(64) static int16_t data[32 * 1024];
+    for (int i = 0; i < 32 * 1024; i++)
+        stream.generate(data, 1024);
+    uint64_t t0 = stream.cur_t() - 32 * 1024;
+    for (auto &tone: tones) {
+        // The double precision error at `t0` is well below the 16bit resolution.
+        tone.phase = std::fmod(tone.phase + tone.freq * double(t0), 1);
+    }
+    check_output(data, 32 * 1024, t0, tones, 2);
+}
+
+static void test_ramp()
+{
+    DataStream stream(2);
+    stream.add_cmd({0, 0, DataStream::CmdType::Phase, 0.2});
+    stream.add_cmd({0, 0, DataStream::CmdType::Freq, 0.01});
+    stream.add_cmd({0, 0, DataStream::CmdType::FreqRamp, 2e-5});
+    stream.add_cmd({0, 0, DataStream::CmdType::Amp, 0.3});
+    stream.add_cmd({0, 1, DataStream::CmdType::Freq, 0.2});
+    stream.add_cmd({0, 1, DataStream::CmdType::AmpRamp, 1e-4});
+    stream.add_cmd({4096, 0, DataStream::CmdType::Hold, 0});
+    stream.add_cmd({4096, 1, DataStream::CmdType::Hold, 0});
+    alignas(64) static int16_t data[32 * 256];
+    stream.generate(data, 256);
+    for (int i = 0; i < 32 * 256; i++) {
+        double t = std::min(i, 4096);
+        double phase0 = 0.2 + 0.01 * t + 2e-5 * t * (t - 1) / 2;
+        double freq0 = 0.01 + 2e-5 * t;
+        double amp1 = 1e-4 * t;
+        double dt = i - t;
+        double expected = (0.3 * std::sin(2 * M_PI * (phase0 + freq0 * dt)) +
+                           amp1 * std::sin(2 * M_PI * 0.2 * i)) * 32767;
+        assert(std::abs(expected - data[i]) <= 3);
+    }
+}
+
+// Static tones mixed with tones ramping the frequency, the amplitude or both,
+// which are generated in separate groups.
+static void test_ramp_groups()
+{
+    struct RampTone {
+        double phase;
+        double freq;
+        double dfreq;
+        double amp;
+        double damp;
+    };
+    // Not sorted by the ramps.
+    std::vector<RampTone> tones{{0.1, 0.02, 0, 0.15, 0},
+                                {0.4, 0.05, 1e-5, 0.1, 0},
+                                {0.6, -0.13, 0, 0.12, 0},
+                                {0.3, 0.11, -2e-5, 0.05, 2e-5},
+                                {0.8, 0.3, 0, 0, 3e-5},
+                                {0.2, -0.27, 0, 0.1, 0}};
+    uint32_t ntones = uint32_t(tones.size());
+    DataStream stream(ntones);
+    for (uint32_t i = 0; i < ntones; i++) {
+        auto &tone = tones[i];
+        stream.add_cmd({0, i, DataStream::CmdType::Phase, tone.phase});
+        stream.add_cmd({0, i, DataStream::CmdType::Freq, tone.freq});
+        stream.add_cmd({0, i, DataStream::CmdType::Amp, tone.amp});
+        if (tone.dfreq != 0)
+            stream.add_cmd({0, i, DataStream::CmdType::FreqRamp, tone.dfreq});
+        if (tone.damp != 0)
+            stream.add_cmd({0, i, DataStream::CmdType::AmpRamp, tone.damp});
+    }
+    for (uint32_t i = 0; i < ntones; i++)
+        stream.add_cmd({4096, i, DataStream::CmdType::Hold, 0});
+    alignas(64) static int16_t data[32 * 256];
+    stream.generate(data, 256);
+    for (int i = 0; i < 32 * 256; i++) {
+        double t = std::min(i, 4096);
+        double dt = i - t;
+        double expected = 0;
+        for (auto &tone: tones) {
+            double phase = tone.phase + tone.freq * t + tone.dfreq * t * (t - 1) / 2;
+            double freq = tone.freq + tone.dfreq * t;
+            double amp = tone.amp + tone.damp * t;
+            expected += amp * std::sin(2 * M_PI * (phase + freq * dt));
+        }
+        assert(std::abs(expected * 32767 - data[i]) <= 4);
+    }
+}
+
+static void test_ramp2()
+{
+    DataStream stream(2);
+    stream.add_cmd({0, 0, DataStream::CmdType::Phase, 0.1});
+    stream.add_cmd({0, 0, DataStream::CmdType::Freq, 0.02});
+    stream.add_cmd({0, 0, DataStream::CmdType::FreqRamp, 1e-5});
+    stream.add_cmd({0, 0, DataStream::CmdType::FreqRamp2, -5e-9});
+    stream.add_cmd({0, 0, DataStream::CmdType::Amp, 0.3});
+    stream.add_cmd({0, 1, DataStream::CmdType::Freq, 0.15});
+    stream.add_cmd({0, 1, DataStream::CmdType::Amp, 0.1});
+    stream.add_cmd({0, 1, DataStream::CmdType::AmpRamp, 1e-4});
+    stream.add_cmd({0, 1, DataStream::CmdType::AmpRamp2, -5e-8});
+    stream.add_cmd({4096, 0, DataStream::CmdType::Hold, 0});
+    stream.add_cmd({4096, 1, DataStream::CmdType::Hold, 0});
+    alignas(64) static int16_t data[32 * 256];
+    stream.generate(data, 256);
+    for (int i = 0; i < 32 * 256; i++) {
+        double t = std::min(i, 4096);
+        double t2 = t * (t - 1) / 2;
+        double t3 = t * (t - 1) * (t - 2) / 6;
+        double phase0 = 0.1 + 0.02 * t + 1e-5 * t2 - 5e-9 * t3;
+        double freq0 = 0.02 + 1e-5 * t - 5e-9 * t2;
+        double amp1 = 0.1 + 1e-4 * t - 5e-8 * t2;
+        double dt = i - t;
+        double expected = (0.3 * std::sin(2 * M_PI * (phase0 + freq0 * dt)) +
+                           amp1 * std::sin(2 * M_PI * 0.15 * i)) * 32767;
+        assert(std::abs(expected - data[i]) <= 3);
+    }
+}
+
+static void test_envelope()
+{
+    DataStream stream(2);
+    stream.add_cmd({0, 0, DataStream::CmdType::Freq, 0.05});
+    stream.add_cmd({0, 0, DataStream::CmdType::Amp, 0.5});
+    stream.add_cmd({0, 0, DataStream::CmdType::EnvShape,
+                    double(DataStream::Envelope::Blackman)});
+    stream.add_cmd({0, 0, DataStream::CmdType::EnvRise, 1024});
+    stream.add_cmd({0, 1, DataStream::CmdType::Freq, -0.13});
+    stream.add_cmd({0, 1, DataStream::CmdType::Amp, 0.2});
+    stream.add_cmd({0, 1, DataStream::CmdType::AmpRamp, 1e-4});
+    stream.add_cmd({0, 1, DataStream::CmdType::EnvShape,
+                    double(DataStream::Envelope::Erf)});
+    // The envelope applies on top of the amplitude ramp.
+    stream.add_cmd({64, 1, DataStream::CmdType::EnvRise, 2048});
+    // Takes effect at 3008 and rounded to 2016 samples.
+    stream.add_cmd({3000, 0, DataStream::CmdType::EnvFall, 2000});
+    stream.add_cmd({3072, 1, DataStream::CmdType::Hold, 0});
+    alignas(64) static int16_t data[32 * 256];
+    stream.generate(data, 256);
+    auto blackman = [] (double x) {
+        return 0.42 - 0.5 * std::cos(M_PI * x) + 0.08 * std::cos(2 * M_PI * x);
+    };
+    for (int i = 0; i < 32 * 256; i++) {
+        double env0 = 1;
+        if (i < 1024) {
+            env0 = blackman(i / 1024.0);
+        }
+        else if (i >= 3008) {
+            env0 = i >= 3008 + 2016 ? 0 : blackman(1 - (i - 3008) / 2016.0);
+        }
+        double env1 = 1;
+        if (i >= 64 && i < 64 + 2048) {
+            env1 = (std::erf(6 * (i - 64) / 2048.0 - 3) / std::erf(3) + 1) / 2;
+        }
+        double amp1 = 0.2 + 1e-4 * std::min(i, 3072);
+        double expected = (0.5 * env0 * std::sin(2 * M_PI * 0.05 * i) +
+                           amp1 * env1 * std::sin(-2 * M_PI * 0.13 * i)) * 32767;
+        assert(std::abs(expected - data[i]) <= 3);
+    }
+}
+
+static void test_multi_chn()
+{
+    for (uint32_t nchns: {2, 4}) {
+        DataStream stream(2, nchns);
+        std::vector<std::vector<RefTone>> tones(nchns);
+        for (uint32_t c = 0; c < nchns; c++) {
+            // Leave the last channel empty.
+            if (c == nchns - 1)
+                continue;
+            tones[c] = {{0.1 * c, 0.01 + 0.1 * c, 0.3}, {0.5, -0.2 + 0.03 * c, 0.2}};
+            for (uint32_t i = 0; i < 2; i++) {
+                auto &tone = tones[c][i];
+                stream.add_cmd({0, c * 2 + i, DataStream::CmdType::Phase, tone.phase});
+                stream.add_cmd({0, c * 2 + i, DataStream::CmdType::Freq, tone.freq});
+                stream.add_cmd({0, c * 2 + i, DataStream::CmdType::Amp, tone.amp});
+            }
+        }
+        alignas(64) static int16_t data[32 * 64 * 4];
+        stream.generate(data, 64);
+        for (uint32_t c = 0; c < nchns; c++) {
+            for (int i = 0; i < 32 * 64; i++) {
+                auto expected = ref_sample(tones[c], 0, i);
+                assert(std::abs(expected - data[i * nchns + c]) <= 3);
+            }
+        }
+    }
+}
+
+static void add_test_cmds(DataStream &stream)
+{
+    for (uint32_t c = 0; c < stream.nchns(); c++) {
+        for (uint32_t i = 0; i < stream.ntones(); i++) {
+            uint32_t idx = c * stream.ntones() + i;
+            stream.add_cmd({0, idx, DataStream::CmdType::Freq, 0.01 + 0.07 * idx});
+            stream.add_cmd({0, idx, DataStream::CmdType::Amp, 0.2});
+        }
+    }
+    stream.add_cmd({1000, 0, DataStream::CmdType::FreqRamp, 3e-7});
+    stream.add_cmd({5000, 1, DataStream::CmdType::AmpRamp, 2e-6});
+    stream.add_cmd({20000, 0, DataStream::CmdType::Hold, 0});
+    stream.add_cmd({40000, 2, DataStream::CmdType::Phase, 0.3});
+    stream.add_cmd({60000, 1, DataStream::CmdType::Amp, 0});
+}
+
+static void test_workers()
+{
+    // The workers must produce the same output as the single threaded generation.
+    constexpr size_t nsteps = 3000;
+    alignas(64) static int16_t data1[32 * nsteps * 2];
+    alignas(64) static int16_t data2[32 * nsteps * 2];
+    DataStream stream1(2, 2);
+    add_test_cmds(stream1);
+    DataStream stream2(2, 2);
+    add_test_cmds(stream2);
+    stream2.set_workers({-1, -1, -1});
+    for (int i = 0; i < 2; i++) {
+        stream1.generate(data1, nsteps);
+        stream2.generate(data2, nsteps);
+        for (size_t j = 0; j < 32 * nsteps * 2; j++) {
+            assert(std::abs(data1[j] - data2[j]) <= 1);
+        }
+    }
+    assert(stream1.cur_t() == stream2.cur_t());
+    uint64_t total = 0;
+    for (auto &stats: stream2.worker_stats())
+        total += stats.nsteps;
+    assert(total == 2 * nsteps);
+}
+
+static void test_saturate()
+{
+    DataStream stream(2);
+    for (uint32_t i = 0; i < 2; i++) {
+        stream.add_cmd({0, i, DataStream::CmdType::Phase, 0.25});
+        stream.add_cmd({0, i, DataStream::CmdType::Amp, 0.8});
+    }
+    alignas(64) int16_t data[32];
+    stream.generate(data, 1);
+    for (auto v: data) {
+        assert(v == 32767);
+    }
+}
+
+static void test_fft()
+{
+    // Enough tones for the FFT synthesizer to be used with all the generators.
+    constexpr uint32_t ntones = 256;
+    DataStream stream(ntones);
+    std::vector<RefTone> tones(ntones);
+    for (uint32_t i = 0; i < ntones; i++) {
+        tones[i] = {std::fmod(i * 0.37, 1), -0.45 + 0.9 * i / ntones + 1.234e-4,
+                    0.9 / ntones};
+        stream.add_cmd({0, i, DataStream::CmdType::Phase, tones[i].phase});
+        stream.add_cmd({0, i, DataStream::CmdType::Freq, tones[i].freq});
+        stream.add_cmd({0, i, DataStream::CmdType::Amp, tones[i].amp});
+    }
+    // Takes effect at 5024, in the middle of a FFT block.
+    stream.add_cmd({5000, 3, DataStream::CmdType::Amp, 0});
+    // Generate in chunks that are not multiples of the FFT block
+    // to mix the FFT with the per step generation.
+    alignas(64) static int16_t data[32 * 40 * 16];
+    for (int i = 0; i < 16; i++)
+        stream.generate(&data[i * 32 * 40], 40);
+    check_output(data, 5024, 0, tones, 3);
+    for (auto &tone: tones)
+        tone.phase += tone.freq * 5024;
+    tones[3].amp = 0;
+    check_output(&data[5024], 32 * 40 * 16 - 5024, 5024, tones, 3);
+}
+
+static void test_periodic()
+{
+    // Frequencies that are multiples of 1/625 and 1/4 so that the output is periodic
+    // and is copied from the cached period for most of the time.
+    DataStream stream(3);
+    std::vector<RefTone> tones{{0.1, 37. / 625, 0.3}, {0.4, -101. / 625, 0.3},
+                               {0.6, 0.25, 0.3}};
+    for (uint32_t i = 0; i < tones.size(); i++) {
+        stream.add_cmd({0, i, DataStream::CmdType::Phase, tones[i].phase});
+        stream.add_cmd({0, i, DataStream::CmdType::Freq, tones[i].freq});
+        stream.add_cmd({0, i, DataStream::CmdType::Amp, tones[i].amp});
+    }
+    // Takes effect at 1000032, the output is periodic again after the change.
+    stream.add_cmd({1000003, 1, DataStream::CmdType::Freq, 0.1});
+    // Chunks that are not multiples of the period.
+    constexpr size_t nsteps = 1000;
+    alignas(64) static int16_t data[32 * nsteps];
+    // Check `n` samples starting at `t` with the phases of `tones` at time 0.
+    auto check = [&] (const int16_t *data, size_t n, uint64_t t) {
+        auto shifted = tones;
+        for (auto &tone: shifted)
+            tone.phase = std::fmod(tone.phase + tone.freq * double(t), 1);
+        check_output(data, n, t, shifted, 3);
+    };
+    constexpr uint64_t cmd_t = 1000032;
+    uint64_t t = 0;
+    for (int i = 0; i < 64; i++) {
+        stream.generate(data, nsteps);
+        auto end = t + 32 * nsteps;
+        if (t < cmd_t && end > cmd_t) {
+            check(data, cmd_t - t, t);
+            tones[1].phase += (tones[1].freq - 0.1) * double(cmd_t);
+            tones[1].freq = 0.1;
+            check(&data[cmd_t - t], end - cmd_t, cmd_t);
+        }
+        else {
+            check(data, 32 * nsteps, t);
+        }
+        t = end;
+    }
+}
+
+// The phase error (in cycles) of the output of a single tone, starting with `tone.phase`,
+// estimated from the first order change of the output with the phase.
+static double phase_error(const int16_t *data, size_t nsamples, const RefTone &tone)
+{
+    double num = 0;
+    double den = 0;
+    for (size_t i = 0; i < nsamples; i++) {
+        auto phase = 2 * M_PI * (tone.phase + tone.freq * double(i));
+        auto expected = tone.amp * std::sin(phase) * 32767;
+        auto deriv = 2 * M_PI * tone.amp * std::cos(phase) * 32767;
+        num += (data[i] - expected) * deriv;
+        den += deriv * deriv;
+    }
+    return num / den;
+}
+
+static void test_periodic_drift()
+{
+    // Period of 4096 samples within the tolerance of the period cache
+    // with the phase drifting by `2^-53` cycles per sample.
+    constexpr double freq = 409. / 4096 + 0x1p-53;
+    // Exact phase at time `t` with the 64bit fixed point frequency, in cycles.
+    auto phase_at = [&] (uint64_t t) {
+        return double(uint64_t(freq * 0x1p64) * t) * 0x1p-64;
+    };
+    DataStream stream(1);
+    stream.add_cmd({0, 0, DataStream::CmdType::Freq, freq});
+    stream.add_cmd({0, 0, DataStream::CmdType::Amp, 0.9});
+    // Change the frequency after a hold of 2^34 samples, or ~27s at 625MS/s,
+    // during which the drift of the period accumulates to `2^-19` cycles.
+    constexpr uint64_t hold = uint64_t(1) << 34;
+    stream.add_cmd({hold, 0, DataStream::CmdType::Freq, 0.05});
+    constexpr size_t nsteps = 32 * 1024;
+    constexpr size_t nsamples = 32 * nsteps;
+    alignas(64) static int16_t data[nsamples];
+    stream.generate(data, nsteps);
+    // The phase error from the generator itself, which is the same for the same phases.
+    auto err0 = phase_error(data, nsamples, {0, freq, 0.9});
+    while (stream.cur_t() < hold)
+        stream.generate(data, nsteps);
+    // The output before the change is continuous with the exact phase of the tone.
+    auto err1 = phase_error(data, nsamples, {phase_at(hold - nsamples), freq, 0.9});
+    assert(std::abs(err1 - err0) < 0x1p-22);
+    stream.generate(data, nsteps);
+    check_output(data, nsamples, hold, {{phase_at(hold), 0.05, 0.9}}, 2);
+}
+
+static void add_shot_cmds(DataStream &stream, uint64_t t0)
+{
+    for (uint32_t i = 0; i < stream.ntones(); i++) {
+        stream.add_cmd({t0, i, DataStream::CmdType::Phase, 0.1 * i});
+        stream.add_cmd({t0, i, DataStream::CmdType::Freq, 0.0123457 + 0.0345679 * i});
+        stream.add_cmd({t0, i, DataStream::CmdType::Amp, 0.2});
+    }
+    stream.add_cmd({t0 + 3000, 0, DataStream::CmdType::FreqRamp, 2e-7});
+    stream.add_cmd({t0 + 10000, 0, DataStream::CmdType::Hold, 0});
+    stream.add_cmd({t0 + 20000, 1, DataStream::CmdType::Amp, 0});
+}
+
+static void test_block_cache()
+{
+    // The same sequence repeated in each shot, generated in different chunks.
+    constexpr size_t shot_steps = 1024;
+    constexpr size_t nshots = 3;
+    alignas(64) static int16_t data1[32 * shot_steps * 2];
+    alignas(64) static int16_t data2[32 * shot_steps * 2];
+    DataStream stream1(3, 2);
+    DataStream stream2(3, 2);
+    stream2.set_block_cache(1 << 20);
+    uint64_t misses = 0;
+    for (size_t shot = 0; shot < nshots; shot++) {
+        add_shot_cmds(stream1, shot * 32 * shot_steps);
+        add_shot_cmds(stream2, shot * 32 * shot_steps);
+        size_t chunk = 100 + 77 * shot;
+        for (size_t i = 0; i < shot_steps; i += chunk) {
+            auto n = std::min(chunk, shot_steps - i);
+            stream1.generate(&data1[i * 32 * 2], n);
+            stream2.generate(&data2[i * 32 * 2], n);
+        }
+        for (size_t j = 0; j < 32 * shot_steps * 2; j++) {
+            assert(std::abs(data1[j] - data2[j]) <= 1);
+        }
+        auto stats = stream2.block_cache_stats();
+        if (shot == 0) {
+            misses = stats.misses;
+            assert(stats.nblocks > 0);
+        }
+        else {
+            // Everything is copied from the cache after the first shot.
+            assert(stats.misses == misses);
+            assert(stats.hits >= shot * shot_steps / 64);
+        }
+        assert(stats.bytes <= 1 << 20);
+    }
+}
+
+static void test_precision()
+{
+    // Maximum error of a nearly full scale tone, including the rounding of the output.
+    auto max_error = [] (DataStream::Precision prec) {
+        DataStream stream(1);
+        stream.set_precision(prec);
+        assert(stream.precision() == prec);
+        RefTone tone{0.3, 0.1234567, 0.99};
+        stream.add_cmd({0, 0, DataStream::CmdType::Phase, tone.phase});
+        stream.add_cmd({0, 0, DataStream::CmdType::Freq, tone.freq});
+        stream.add_cmd({0, 0, DataStream::CmdType::Amp, tone.amp});
+        alignas(64) static int16_t data[32 * 1024];
+        stream.generate(data, 1024);
+        double err = 0;
+        for (size_t i = 0; i < 32 * 1024; i++)
+            err = std::max(err, std::abs(ref_sample({tone}, 0, i) - data[i]));
+        return err;
+    };
+    auto low = max_error(DataStream::Precision::Low);
+    auto def = max_error(DataStream::Precision::Default);
+    auto high = max_error(DataStream::Precision::High);
+    assert(low <= 5);
+    assert(def <= 0.8);
+    assert(high <= 0.55);
+    assert(high <= def && def <= low);
+}
+
+int main()
+{
+    test_static();
+    test_cmd_time();
+    test_long_run();
+    test_ramp();
+    test_ramp_groups();
+    test_ramp2();
+    test_envelope();
+    test_multi_chn();
+    test_workers();
+    test_saturate();
+    test_fft();
+    test_periodic();
+    test_periodic_drift();
+    test_block_cache();
+    test_precision();
+    return 0;
+}
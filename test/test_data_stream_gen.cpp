@@ -16,11 +16,11 @@
  *   see <http://www.gnu.org/licenses/>.                                 *
  *************************************************************************/
 
-#include "calc_wave_helper.h"
+#include "../nacs-spcm/data_stream_p.h"
+#include "../nacs-spcm/fft_synth_p.h"
 
 #include <nacs-utils/mem.h>
 #include <nacs-utils/number.h>
-#include <nacs-utils/processor.h>
 #include <nacs-utils/timer.h>
 
 #include <assert.h>
@@ -33,15 +33,16 @@
 using namespace NaCs;
 using namespace NaCs::Spcm;
 
+template<int S = step_size>
 static double calc_wave_fixed(float *output, int nchns, const channel_param_fixed *params)
 {
     assert(nchns > 0);
     double total_amp = 0;
-    for (int i = 0; i < step_size; i++) {
+    for (int i = 0; i < S; i++) {
         double o = 0;
         for (int c = 0; c < nchns; c++) {
             auto p = params[c];
-            auto phase = (double)p.phase + (double)p.freq * (double)i / 16;
+            auto phase = (double)p.phase + (double)p.freq * (double)i * 2 / S;
             o += std::sin(phase * M_PI) / M_PI * (double)p.amp;
             total_amp += p.amp;
         }
@@ -50,17 +51,18 @@ static double calc_wave_fixed(float *output, int nchns, const channel_param_fixe
     return total_amp;
 }
 
+template<int S = step_size>
 static double calc_wave(float *output, int nchns, const channel_param *params)
 {
     assert(nchns > 0);
     double total_amp = 0;
-    for (int i = 0; i < step_size; i++) {
+    for (int i = 0; i < S; i++) {
         double o = 0;
         for (int c = 0; c < nchns; c++) {
             auto p = params[c];
-            auto phase = (double)p.phase[0] + (double)p.freq[0] * (double)i / 16;
-            phase += (double)p.dfreq[0] * (double)(i * i) / 512;
-            auto amp = (double)p.amp[0] + (double)p.damp[0] * (double)i / 16;
+            auto phase = (double)p.phase[0] + (double)p.freq[0] * (double)i * 2 / S;
+            phase += (double)p.dfreq[0] * (double)(i * i) * 2 / (S * S);
+            auto amp = (double)p.amp[0] + (double)p.damp[0] * (double)i * 2 / S;
             o += std::sin(phase * M_PI) / M_PI * amp;
             total_amp += p.amp[0] + max(0, p.damp[0]);
         }
@@ -69,6 +71,26 @@ static double calc_wave(float *output, int nchns, const channel_param *params)
     return total_amp;
 }
 
+static double calc_wave_ramp2(float *output, int nchns, const channel_param_ramp2 *params)
+{
+    assert(nchns > 0);
+    double total_amp = 0;
+    for (int i = 0; i < step_size; i++) {
+        double o = 0;
+        double t = (double)i * 2 / step_size;
+        for (int c = 0; c < nchns; c++) {
+            auto p = params[c];
+            auto phase = ((double)p.phase + (double)p.freq * t +
+                          (double)p.dfreq * t * t / 2 + (double)p.ddfreq * t * t * t / 4);
+            auto amp = (double)p.amp + (double)p.damp * t + (double)p.ddamp * t * t / 2;
+            o += std::sin(phase * M_PI) / M_PI * amp;
+            total_amp += p.amp + max(0, p.damp) + max(0, p.ddamp);
+        }
+        output[i] = (float)o;
+    }
+    return total_amp;
+}
+
 static bool approx_array(const float *a1, const float *a2, size_t sz, double tol)
 {
     for (size_t i = 0; i < sz; i++) {
@@ -80,10 +102,25 @@ static bool approx_array(const float *a1, const float *a2, size_t sz, double tol
     return true;
 }
 
+// Compare the integer output to the saturated reference.
+static bool approx_array_i16(const float *a1, const int16_t *a2, size_t sz, double tol)
+{
+    for (size_t i = 0; i < sz; i++) {
+        auto expected = std::min(std::max(a1[i], -32768.0f), 32767.0f);
+        auto diff = std::abs(expected - a2[i]);
+        if (!(diff < tol + 0.5)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 template<typename Gen>
 static void test_gen_fixed(const float *expected, float *buff, int nchn,
                            const channel_param_fixed *params_fixed, double tol)
 {
+    if (!Gen::supported())
+        return;
     memset(buff, 0, step_size * sizeof(float));
     Runner<Gen>::run_wave_fixed(buff, step_size, 1, nchn, params_fixed);
     assert(approx_array(expected, buff, step_size, tol));
@@ -91,11 +128,43 @@ static void test_gen_fixed(const float *expected, float *buff, int nchn,
 
 template<typename Gen>
 static void test_gen(const float *expected, float *buff, int nchn,
-                     const channel_param *params, double tol)
+                     const channel_param *params,
+                     const channel_param_packed *params_packed, double tol)
 {
+    if (!Gen::supported())
+        return;
     memset(buff, 0, step_size * sizeof(float));
     Runner<Gen>::run_wave(buff, step_size, 1, nchn, params);
     assert(approx_array(expected, buff, step_size, tol));
+    memset(buff, 0, step_size * sizeof(float));
+    Runner<Gen>::run_wave_packed(buff, step_size, 1, nchn, params_packed);
+    assert(approx_array(expected, buff, step_size, tol));
+}
+
+template<typename Gen>
+static void test_gen_fixed_i16(const float *expected, int16_t *buff, int nchn,
+                               const channel_param_fixed *params_fixed, double tol)
+{
+    if (!Gen::supported())
+        return;
+    memset(buff, 0, step_size * sizeof(int16_t));
+    Runner<Gen>::run_wave_fixed(buff, step_size, 1, nchn, params_fixed);
+    assert(approx_array_i16(expected, buff, step_size, tol));
+}
+
+template<typename Gen>
+static void test_gen_i16(const float *expected, int16_t *buff, int nchn,
+                         const channel_param *params,
+                         const channel_param_packed *params_packed, double tol)
+{
+    if (!Gen::supported())
+        return;
+    memset(buff, 0, step_size * sizeof(int16_t));
+    Runner<Gen>::run_wave(buff, step_size, 1, nchn, params);
+    assert(approx_array_i16(expected, buff, step_size, tol));
+    memset(buff, 0, step_size * sizeof(int16_t));
+    Runner<Gen>::run_wave_packed(buff, step_size, 1, nchn, params_packed);
+    assert(approx_array_i16(expected, buff, step_size, tol));
 }
 
 static void test_fixed_param(float *buff1, float *buff2,
@@ -105,46 +174,83 @@ static void test_fixed_param(float *buff1, float *buff2,
     // We only need 2^-15 ~ 3e-5.
     auto tol = calc_wave_fixed(buff1, nchn, params_fixed) * 0.5e-5;
     test_gen_fixed<ScalarGen>(buff1, buff2, nchn, params_fixed, tol);
-
-    auto &host NACS_UNUSED = CPUInfo::get_host();
 #if NACS_CPU_X86 || NACS_CPU_X86_64
     test_gen_fixed<SSE2Gen>(buff1, buff2, nchn, params_fixed, tol);
-    if (host.test_feature(X86::Feature::avx)) {
-        test_gen_fixed<AVXGen>(buff1, buff2, nchn, params_fixed, tol);
-    }
-    if (host.test_feature(X86::Feature::avx2) && host.test_feature(X86::Feature::fma)) {
-        test_gen_fixed<AVX2Gen>(buff1, buff2, nchn, params_fixed, tol);
-    }
-    if (host.test_feature(X86::Feature::avx512f) &&
-        host.test_feature(X86::Feature::avx512dq)) {
-        test_gen_fixed<AVX512Gen>(buff1, buff2, nchn, params_fixed, tol);
-    }
+    test_gen_fixed<AVXGen>(buff1, buff2, nchn, params_fixed, tol);
+    test_gen_fixed<AVX2Gen>(buff1, buff2, nchn, params_fixed, tol);
+    test_gen_fixed<RotatorGen>(buff1, buff2, nchn, params_fixed, tol);
+    test_gen_fixed<AVX512Gen>(buff1, buff2, nchn, params_fixed, tol);
+#elif NACS_CPU_AARCH64
+    test_gen_fixed<NEONGen>(buff1, buff2, nchn, params_fixed, tol);
+#  ifdef NACS_SPCM_SVE
+    test_gen_fixed<SVEGen>(buff1, buff2, nchn, params_fixed, tol);
+#  endif
 #endif
 }
 
-static void test_param(float *buff1, float *buff2, int nchn, const channel_param *params)
+static void test_fixed_param_i16(float *buff1, int16_t *buff2,
+                                 int nchn, const channel_param_fixed *params_fixed)
+{
+    auto tol = calc_wave_fixed(buff1, nchn, params_fixed) * 0.5e-5;
+    test_gen_fixed_i16<ScalarGen>(buff1, buff2, nchn, params_fixed, tol);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+    test_gen_fixed_i16<SSE2Gen>(buff1, buff2, nchn, params_fixed, tol);
+    test_gen_fixed_i16<AVXGen>(buff1, buff2, nchn, params_fixed, tol);
+    test_gen_fixed_i16<AVX2Gen>(buff1, buff2, nchn, params_fixed, tol);
+    test_gen_fixed_i16<RotatorGen>(buff1, buff2, nchn, params_fixed, tol);
+    test_gen_fixed_i16<AVX512Gen>(buff1, buff2, nchn, params_fixed, tol);
+#elif NACS_CPU_AARCH64
+    test_gen_fixed_i16<NEONGen>(buff1, buff2, nchn, params_fixed, tol);
+#  ifdef NACS_SPCM_SVE
+    test_gen_fixed_i16<SVEGen>(buff1, buff2, nchn, params_fixed, tol);
+#  endif
+#endif
+}
+
+static void test_param(float *buff1, float *buff2, int nchn, const channel_param *params,
+                       const channel_param_packed *params_packed)
 {
     // The 0.5e-5 tolarance to max amplitude is about 6x better than what we need.
     // We only need 2^-15 ~ 3e-5.
     auto tol = calc_wave(buff1, nchn, params) * 0.5e-5;
-    test_gen<ScalarGen>(buff1, buff2, nchn, params, tol);
+    test_gen<ScalarGen>(buff1, buff2, nchn, params, params_packed, tol);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+    test_gen<SSE2Gen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen<AVXGen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen<AVX2Gen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen<RotatorGen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen<AVX512Gen>(buff1, buff2, nchn, params, params_packed, tol);
+#elif NACS_CPU_AARCH64
+    test_gen<NEONGen>(buff1, buff2, nchn, params, params_packed, tol);
+#  ifdef NACS_SPCM_SVE
+    test_gen<SVEGen>(buff1, buff2, nchn, params, params_packed, tol);
+#  endif
+#endif
+}
 
-    auto &host NACS_UNUSED = CPUInfo::get_host();
+static void test_param_i16(float *buff1, int16_t *buff2, int nchn,
+                           const channel_param *params,
+                           const channel_param_packed *params_packed)
+{
+    auto tol = calc_wave(buff1, nchn, params) * 0.5e-5;
+    test_gen_i16<ScalarGen>(buff1, buff2, nchn, params, params_packed, tol);
 #if NACS_CPU_X86 || NACS_CPU_X86_64
-    test_gen<SSE2Gen>(buff1, buff2, nchn, params, tol);
-    if (host.test_feature(X86::Feature::avx)) {
-        test_gen<AVXGen>(buff1, buff2, nchn, params, tol);
-    }
-    if (host.test_feature(X86::Feature::avx2) && host.test_feature(X86::Feature::fma)) {
-        test_gen<AVX2Gen>(buff1, buff2, nchn, params, tol);
-    }
-    if (host.test_feature(X86::Feature::avx512f) &&
-        host.test_feature(X86::Feature::avx512dq)) {
-        test_gen<AVX512Gen>(buff1, buff2, nchn, params, tol);
-    }
+    test_gen_i16<SSE2Gen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen_i16<AVXGen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen_i16<AVX2Gen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen_i16<RotatorGen>(buff1, buff2, nchn, params, params_packed, tol);
+    test_gen_i16<AVX512Gen>(buff1, buff2, nchn, params, params_packed, tol);
+#elif NACS_CPU_AARCH64
+    test_gen_i16<NEONGen>(buff1, buff2, nchn, params, params_packed, tol);
+#  ifdef NACS_SPCM_SVE
+    test_gen_i16<SVEGen>(buff1, buff2, nchn, params, params_packed, tol);
+#  endif
 #endif
 }
 
+// With the amplitude in `[0, 2]` this covers outputs of up to ~`2^15` per channel.
+static constexpr float i16_scale = 20000;
+
 static std::random_device rd;  // Will be used to obtain a seed for the random number engine
 static std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
 
@@ -157,19 +263,17 @@ static void test_fixed_nchn(float *buff1, float *buff2, int nchn, int rep)
         for (int i = 0; i < nchn; i++)
             ps[i] = {pf_dis(gen), pf_dis(gen), a_dis(gen)};
         test_fixed_param(buff1, buff2, nchn, ps.data());
+        // Scale the amplitude to cover both the full 16bit range and the saturation.
+        for (int i = 0; i < nchn; i++)
+            ps[i].amp *= i16_scale;
+        test_fixed_param_i16(buff1, (int16_t*)buff2, nchn, ps.data());
     }
 }
 
 static void test_nchn(float *buff1, float *buff2, int nchn, int rep)
 {
-    struct param {
-        float phase;
-        float freq;
-        float dfreq;
-        float amp;
-        float damp;
-    };
-    std::vector<param> real_ps(nchn);
+    // Also used as the packed parameters.
+    std::vector<channel_param_packed> real_ps(nchn);
     std::vector<channel_param> ps(nchn);
     for (int i = 0; i < nchn; i++)
         ps[i] = {&real_ps[i].phase, &real_ps[i].freq, &real_ps[i].dfreq,
@@ -179,13 +283,563 @@ static void test_nchn(float *buff1, float *buff2, int nchn, int rep)
     for (int j = 0; j < rep; j++) {
         for (int i = 0; i < nchn; i++)
             real_ps[i] = {pf_dis(gen), pf_dis(gen), pf_dis(gen), a_dis(gen), a_dis(gen)};
-        test_param(buff1, buff2, nchn, ps.data());
+        test_param(buff1, buff2, nchn, ps.data(), real_ps.data());
+        for (int i = 0; i < nchn; i++) {
+            real_ps[i].amp *= i16_scale;
+            real_ps[i].damp *= i16_scale;
+        }
+        test_param_i16(buff1, (int16_t*)buff2, nchn, ps.data(), real_ps.data());
+    }
+}
+
+// The maximum error of each of the precision tiers relative to the total amplitude
+// is checked against the expected accuracy of the sine function
+// so that the higher precision versions can't silently fall back to the default.
+template<typename Gen>
+static void test_gen_prec(const float *expected, float *buff, int nchn,
+                          const channel_param_fixed *params, double tol)
+{
+    if (!Gen::supported())
+        return;
+    Runner<Gen>::run_wave_fixed(buff, step_size, 1, nchn, params);
+    assert(approx_array(expected, buff, step_size, tol));
+}
+
+template<template<Precision> class Gen>
+static void test_gen_precs(const float *expected, float *buff, int nchn,
+                           const channel_param_fixed *params, double amp)
+{
+    test_gen_prec<Gen<Precision::Low>>(expected, buff, nchn, params, amp * 5e-5);
+    test_gen_prec<Gen<Precision::Default>>(expected, buff, nchn, params, amp * 3e-6);
+    test_gen_prec<Gen<Precision::High>>(expected, buff, nchn, params, amp * 3e-7);
+}
+
+static void test_precision(float *buff1, float *buff2, int nchn, int rep)
+{
+    std::vector<channel_param_fixed> ps(nchn);
+    std::uniform_real_distribution<float> p_dis(-2, 2);
+    // Large enough for the error of the phase to dominate without the reduction.
+    std::uniform_real_distribution<float> f_dis(-15, 15);
+    std::uniform_real_distribution<float> a_dis(0, 2);
+    for (int j = 0; j < rep; j++) {
+        for (int i = 0; i < nchn; i++)
+            ps[i] = {p_dis(gen), f_dis(gen), a_dis(gen)};
+        auto amp = calc_wave_fixed(buff1, nchn, ps.data()) / step_size;
+        test_gen_precs<ScalarGenT>(buff1, buff2, nchn, ps.data(), amp);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_gen_precs<SSE2GenT>(buff1, buff2, nchn, ps.data(), amp);
+        test_gen_precs<AVXGenT>(buff1, buff2, nchn, ps.data(), amp);
+        test_gen_precs<AVX2GenT>(buff1, buff2, nchn, ps.data(), amp);
+        test_gen_precs<AVX512GenT>(buff1, buff2, nchn, ps.data(), amp);
+#elif NACS_CPU_AARCH64
+        test_gen_precs<NEONGenT>(buff1, buff2, nchn, ps.data(), amp);
+#  ifdef NACS_SPCM_SVE
+        test_gen_precs<SVEGenT>(buff1, buff2, nchn, ps.data(), amp);
+#  endif
+#endif
+    }
+}
+
+template<typename Gen>
+static void test_gen_ramp2(const float *expected, int16_t *buff, int nchn,
+                           const channel_param_ramp2 *params, double tol)
+{
+    if (!Gen::supported())
+        return;
+    memset(buff, 0, step_size * sizeof(int16_t));
+    Runner<Gen>::template run_wave_multi<1>(buff, step_size, 1, &nchn, &params);
+    assert(approx_array_i16(expected, buff, step_size, tol));
+}
+
+// The second order ramps are only supported by the multi-channel generators.
+static void test_ramp2(float *buff1, int16_t *buff2, int nchn, int rep)
+{
+    std::vector<channel_param_ramp2> ps(nchn);
+    std::uniform_real_distribution<float> pf_dis(-2, 2);
+    std::uniform_real_distribution<float> a_dis(0, 2);
+    for (int j = 0; j < rep; j++) {
+        for (int i = 0; i < nchn; i++) {
+            ps[i] = {pf_dis(gen), pf_dis(gen), pf_dis(gen), pf_dis(gen),
+                     a_dis(gen), a_dis(gen), a_dis(gen)};
+        }
+        for (int i = 0; i < nchn; i++) {
+            ps[i].amp *= i16_scale;
+            ps[i].damp *= i16_scale;
+            ps[i].ddamp *= i16_scale;
+        }
+        auto tol = calc_wave_ramp2(buff1, nchn, ps.data()) * 0.5e-5;
+        test_gen_ramp2<ScalarGen>(buff1, buff2, nchn, ps.data(), tol);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_gen_ramp2<SSE2Gen>(buff1, buff2, nchn, ps.data(), tol);
+        test_gen_ramp2<AVXGen>(buff1, buff2, nchn, ps.data(), tol);
+        test_gen_ramp2<AVX2Gen>(buff1, buff2, nchn, ps.data(), tol);
+        test_gen_ramp2<RotatorGen>(buff1, buff2, nchn, ps.data(), tol);
+        test_gen_ramp2<AVX512Gen>(buff1, buff2, nchn, ps.data(), tol);
+#elif NACS_CPU_AARCH64
+        test_gen_ramp2<NEONGen>(buff1, buff2, nchn, ps.data(), tol);
+#  ifdef NACS_SPCM_SVE
+        test_gen_ramp2<SVEGen>(buff1, buff2, nchn, ps.data(), tol);
+#  endif
+#endif
+    }
+}
+
+template<typename Gen, int S>
+static void test_gen_step(const float *expected_fixed, const float *expected, float *buff,
+                          int nchn, const channel_param_fixed *params_fixed,
+                          const channel_param_packed *params_packed,
+                          double tol_fixed, double tol)
+{
+    if (!Gen::supported())
+        return;
+    memset(buff, 0, S * sizeof(float));
+    Runner<Gen>::template run_wave_fixed<S>(buff, S, 1, nchn, params_fixed);
+    assert(approx_array(expected_fixed, buff, S, tol_fixed));
+    memset(buff, 0, S * sizeof(float));
+    Runner<Gen>::template run_wave_packed<S>(buff, S, 1, nchn, params_packed);
+    assert(approx_array(expected, buff, S, tol));
+}
+
+// Generators instantiated for the non-default step sizes.
+template<int S>
+static void test_step_size(float *buff1, float *buff2, int nchn, int rep)
+{
+    std::vector<channel_param_fixed> fixed_ps(nchn);
+    std::vector<channel_param_packed> real_ps(nchn);
+    std::vector<channel_param> ps(nchn);
+    for (int i = 0; i < nchn; i++)
+        ps[i] = {&real_ps[i].phase, &real_ps[i].freq, &real_ps[i].dfreq,
+                 &real_ps[i].amp, &real_ps[i].damp};
+    std::uniform_real_distribution<float> pf_dis(-2, 2);
+    std::uniform_real_distribution<float> a_dis(0, 2);
+    auto expected = &buff1[S];
+    for (int j = 0; j < rep; j++) {
+        for (int i = 0; i < nchn; i++) {
+            fixed_ps[i] = {pf_dis(gen), pf_dis(gen), a_dis(gen)};
+            real_ps[i] = {pf_dis(gen), pf_dis(gen), pf_dis(gen), a_dis(gen), a_dis(gen)};
+        }
+        auto tol_fixed = calc_wave_fixed<S>(buff1, nchn, fixed_ps.data()) * 0.5e-5;
+        auto tol = calc_wave<S>(expected, nchn, ps.data()) * 0.5e-5;
+        test_gen_step<ScalarGen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                    real_ps.data(), tol_fixed, tol);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_gen_step<SSE2Gen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                  real_ps.data(), tol_fixed, tol);
+        test_gen_step<AVXGen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                 real_ps.data(), tol_fixed, tol);
+        test_gen_step<AVX2Gen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                  real_ps.data(), tol_fixed, tol);
+        test_gen_step<RotatorGen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                     real_ps.data(), tol_fixed, tol);
+        test_gen_step<AVX512Gen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                    real_ps.data(), tol_fixed, tol);
+#elif NACS_CPU_AARCH64
+        test_gen_step<NEONGen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                  real_ps.data(), tol_fixed, tol);
+#  ifdef NACS_SPCM_SVE
+        test_gen_step<SVEGen, S>(buff1, expected, buff2, nchn, fixed_ps.data(),
+                                 real_ps.data(), tol_fixed, tol);
+#  endif
+#endif
+    }
+}
+
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+// The integer generators are less accurate so they are compared to the reference
+// separately and the maximum error (in LSB of the output) is reported at the end.
+struct Q15Error {
+    double fixed = 0;
+    double ramp = 0;
+};
+// For 1 and for more tones.
+static Q15Error avx2_q15_err[2];
+static Q15Error avx512_q15_err[2];
+
+static double max_error_i16(const float *expected, const int16_t *buff, size_t sz)
+{
+    double err = 0;
+    for (size_t i = 0; i < sz; i++)
+        err = std::max(err, std::abs(double(expected[i]) - buff[i]));
+    return err;
+}
+
+template<typename Gen, int S>
+static void test_gen_q15(float *buff1, int16_t *buff2, int nchn,
+                         const channel_param_fixed *fixed_ps, const channel_param *ps,
+                         const channel_param_packed *packed_ps, Q15Error &err)
+{
+    if (!Gen::supported())
+        return;
+    // The error of the sine and the phase resolution add up to ~5 LSB
+    // for the full range (i.e. the sum of the amplitudes)
+    // in addition to the rounding of each tone.
+    double tol = 5 + 0.5 * nchn;
+    calc_wave_fixed<S>(buff1, nchn, fixed_ps);
+    Runner<Gen>::template run_wave_fixed<S>(buff2, S, 1, nchn, fixed_ps);
+    auto e = max_error_i16(buff1, buff2, S);
+    assert(e <= tol);
+    err.fixed = std::max(err.fixed, e);
+    // The `float` output is converted from the same integer result.
+    auto fbuff = (float*)&buff2[1024];
+    Runner<Gen>::template run_wave_fixed<S>(fbuff, S, 1, nchn, fixed_ps);
+    for (int i = 0; i < S; i++)
+        assert(fbuff[i] == buff2[i]);
+
+    calc_wave<S>(buff1, nchn, ps);
+    Runner<Gen>::template run_wave<S>(buff2, S, 1, nchn, ps);
+    e = max_error_i16(buff1, buff2, S);
+    assert(e <= tol);
+    err.ramp = std::max(err.ramp, e);
+    Runner<Gen>::template run_wave_packed<S>(buff2, S, 1, nchn, packed_ps);
+    e = max_error_i16(buff1, buff2, S);
+    assert(e <= tol);
+    err.ramp = std::max(err.ramp, e);
+
+    // Each interleaved channel is the same as the single channel output.
+    constexpr int nout = 4;
+    int nchns[nout];
+    const channel_param_fixed *pps[nout];
+    for (int o = 0; o < nout; o++) {
+        nchns[o] = std::max(nchn - o, 0);
+        pps[o] = &fixed_ps[std::min(o, nchn - 1)];
+    }
+    auto multi = &buff2[S];
+    Runner<Gen>::template run_wave_multi<nout, S>(multi, S, 1, nchns, pps);
+    for (int o = 0; o < nout; o++) {
+        if (nchns[o] == 0) {
+            memset(buff2, 0, S * sizeof(int16_t));
+        }
+        else {
+            Runner<Gen>::template run_wave_fixed<S>(buff2, S, 1, nchns[o], pps[o]);
+        }
+        for (int i = 0; i < S; i++) {
+            assert(multi[i * nout + o] == buff2[i]);
+        }
+    }
+}
+
+template<int S>
+static void test_q15(float *buff1, int16_t *buff2, int nchn, int rep)
+{
+    std::vector<channel_param_fixed> fixed_ps(nchn);
+    std::vector<channel_param_packed> real_ps(nchn);
+    std::vector<channel_param> ps(nchn);
+    for (int i = 0; i < nchn; i++)
+        ps[i] = {&real_ps[i].phase, &real_ps[i].freq, &real_ps[i].dfreq,
+                 &real_ps[i].amp, &real_ps[i].damp};
+    std::uniform_real_distribution<float> pf_dis(-2, 2);
+    // Keep the sum of the amplitudes within the 16bit range.
+    std::uniform_real_distribution<float> a_dis(0, float(32767 * M_PI / nchn));
+    for (int j = 0; j < rep; j++) {
+        for (int i = 0; i < nchn; i++) {
+            fixed_ps[i] = {pf_dis(gen), pf_dis(gen), a_dis(gen)};
+            real_ps[i] = {pf_dis(gen), pf_dis(gen), pf_dis(gen),
+                          a_dis(gen) / 3, a_dis(gen) / 3};
+        }
+        test_gen_q15<AVX2Q15Gen, S>(buff1, buff2, nchn, fixed_ps.data(), ps.data(),
+                                    real_ps.data(), avx2_q15_err[nchn > 1]);
+        test_gen_q15<AVX512Q15Gen, S>(buff1, buff2, nchn, fixed_ps.data(), ps.data(),
+                                      real_ps.data(), avx512_q15_err[nchn > 1]);
+    }
+}
+
+template<typename Gen>
+static void report_q15(const Q15Error *err)
+{
+    if (!Gen::supported())
+        return;
+    std::cout << Gen::name() << " max error: 1 tone: "
+              << err[0].fixed << " LSB (fixed), " << err[0].ramp << " LSB (ramp); "
+              << "10 tones: " << err[1].fixed << " LSB (fixed), "
+              << err[1].ramp << " LSB (ramp)" << std::endl;
+}
+#endif
+
+static void test_fft_synth(float *buff1, float *buff2, int nchn, int rep)
+{
+    std::uniform_real_distribution<double> phase_dis(0, 1);
+    std::uniform_real_distribution<double> freq_dis(-0.5, 0.5);
+    std::uniform_real_distribution<double> amp_dis(0, 2);
+    std::vector<FFTSynth::Tone> tones(nchn);
+    FFTSynth synth;
+    for (int j = 0; j < rep; j++) {
+        double total_amp = 0;
+        for (auto &tone: tones) {
+            tone = {phase_dis(gen), freq_dis(gen), amp_dis(gen)};
+            total_amp += tone.amp;
+        }
+        synth.run(buff2, tones.data(), nchn);
+        // Check the block in chunks of `step_size` to reuse the buffers.
+        for (int i0 = 0; i0 < FFTSynth::block_size; i0 += step_size) {
+            for (int i = 0; i < step_size; i++) {
+                double o = 0;
+                for (auto &tone: tones)
+                    o += tone.amp * std::sin(2 * M_PI * (tone.phase +
+                                                         tone.freq * (i0 + i)));
+                buff1[i] = (float)o;
+            }
+            assert(approx_array(buff1, &buff2[i0], step_size, total_amp * 0.5e-5));
+        }
+    }
+}
+
+template<typename Gen, int nout, typename P>
+static void test_gen_multi(const float *expected, int16_t *buff, const int *nchns,
+                           const P *const *params, const double *tol)
+{
+    if (!Gen::supported())
+        return;
+    memset(buff, 0, step_size * nout * sizeof(int16_t));
+    Runner<Gen>::template run_wave_multi<nout, step_size, P>(buff, step_size, 1,
+                                                             nchns, params);
+    int16_t chn_buff[step_size];
+    for (int o = 0; o < nout; o++) {
+        for (int i = 0; i < step_size; i++)
+            chn_buff[i] = buff[i * nout + o];
+        assert(approx_array_i16(&expected[o * step_size], chn_buff, step_size, tol[o]));
+    }
+}
+
+// Multiple steps of constant tones in one call (`run_wave_steps`),
+// compared to each step computed separately.
+// A non-zero `ntones` uses the kernel unrolled for the tone count
+// (`run_wave_steps_ntones`) instead, which only supports a single output channel.
+template<typename Gen, int nout, int ntones = 0>
+static void test_gen_steps(float *expected, int16_t *buff, size_t nsteps, const int *nchns,
+                           std::vector<channel_param_fixed> *params,
+                           const std::vector<uint32_t> *phase,
+                           const std::vector<uint32_t> *dphase)
+{
+    if (!Gen::supported())
+        return;
+    channel_param_fixed *pps[nout];
+    const uint32_t *pphase[nout];
+    const uint32_t *pdphase[nout];
+    for (int o = 0; o < nout; o++) {
+        pps[o] = params[o].data();
+        pphase[o] = phase[o].data();
+        pdphase[o] = dphase[o].data();
+    }
+    memset(buff, 0, nsteps * step_size * nout * sizeof(int16_t));
+    if (ntones) {
+        assert(nout == 1 && nchns[0] == ntones);
+        // Don't instantiate the kernel without any tones for the generic case.
+        constexpr int n = ntones ? ntones : 1;
+        Runner<Gen>::template run_wave_steps_ntones<n>(buff, nsteps, nchns, pps,
+                                                       pphase, pdphase);
+    }
+    else {
+        Runner<Gen>::template run_wave_steps<nout>(buff, nsteps, nchns, pps,
+                                                   pphase, pdphase);
+    }
+    for (size_t s = 0; s < nsteps; s++) {
+        for (int o = 0; o < nout; o++) {
+            int16_t chn_buff[step_size];
+            for (int i = 0; i < step_size; i++)
+                chn_buff[i] = buff[(s * step_size + i) * nout + o];
+            double tol = 0;
+            if (nchns[o]) {
+                auto ps = params[o];
+                for (int k = 0; k < nchns[o]; k++) {
+                    uint32_t ph = phase[o][k] + uint32_t(s) * dphase[o][k];
+                    ps[k].phase = float(int32_t(ph)) * 0x1p-31f;
+                }
+                tol = calc_wave_fixed(expected, nchns[o], ps.data()) * 0.5e-5;
+            }
+            else {
+                memset(expected, 0, step_size * sizeof(float));
+            }
+            assert(approx_array_i16(expected, chn_buff, step_size, tol));
+        }
+    }
+}
+
+template<int nout>
+static void test_steps(float *buff1, int16_t *buff2, int rep)
+{
+    // Fills the `int16_t` buffer.
+    constexpr size_t nsteps = 2048 / step_size / nout;
+    std::uniform_real_distribution<float> f_dis(-2, 2);
+    std::uniform_real_distribution<float> a_dis(0, 2);
+    std::uniform_int_distribution<uint32_t> ph_dis;
+    std::uniform_int_distribution<int> n_dis(0, 4);
+    std::vector<channel_param_fixed> ps[nout];
+    std::vector<uint32_t> phase[nout];
+    std::vector<uint32_t> dphase[nout];
+    int nchns[nout];
+    for (int j = 0; j < rep; j++) {
+        for (int o = 0; o < nout; o++) {
+            // Including channels without any tones.
+            nchns[o] = n_dis(gen);
+            ps[o].resize(nchns[o]);
+            phase[o].resize(nchns[o]);
+            dphase[o].resize(nchns[o]);
+            for (int k = 0; k < nchns[o]; k++) {
+                // The frequency is in cycles per step and the phase is in unit of pi.
+                auto freq = f_dis(gen);
+                ps[o][k] = {0, freq, a_dis(gen) * i16_scale};
+                phase[o][k] = ph_dis(gen);
+                dphase[o][k] = uint32_t(int64_t(double(freq) * 0x1p32));
+            }
+        }
+        test_gen_steps<ScalarGen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_gen_steps<SSE2Gen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+        test_gen_steps<AVXGen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+        test_gen_steps<AVX2Gen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+        test_gen_steps<RotatorGen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+        test_gen_steps<AVX512Gen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+#elif NACS_CPU_AARCH64
+        test_gen_steps<NEONGen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+#  ifdef NACS_SPCM_SVE
+        test_gen_steps<SVEGen, nout>(buff1, buff2, nsteps, nchns, ps, phase, dphase);
+#  endif
+#endif
+    }
+}
+
+template<int nout>
+static void test_multi(float *buff1, int16_t *buff2, int rep)
+{
+    std::uniform_real_distribution<float> pf_dis(-2, 2);
+    std::uniform_real_distribution<float> a_dis(0, 2);
+    std::uniform_int_distribution<int> n_dis(0, 4);
+    std::vector<channel_param_fixed> ps[nout];
+    const channel_param_fixed *pps[nout];
+    int nchns[nout];
+    double tol[nout];
+    for (int j = 0; j < rep; j++) {
+        for (int o = 0; o < nout; o++) {
+            // Including channels without any tones.
+            nchns[o] = n_dis(gen);
+            ps[o].resize(nchns[o]);
+            for (auto &p: ps[o])
+                p = {pf_dis(gen), pf_dis(gen), a_dis(gen) * i16_scale};
+            pps[o] = ps[o].data();
+            if (nchns[o] == 0) {
+                memset(&buff1[o * step_size], 0, step_size * sizeof(float));
+                tol[o] = 0;
+            }
+            else {
+                tol[o] = calc_wave_fixed(&buff1[o * step_size], nchns[o], pps[o]) * 0.5e-5;
+            }
+        }
+        test_gen_multi<ScalarGen, nout>(buff1, buff2, nchns, pps, tol);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_gen_multi<SSE2Gen, nout>(buff1, buff2, nchns, pps, tol);
+        test_gen_multi<AVXGen, nout>(buff1, buff2, nchns, pps, tol);
+        test_gen_multi<AVX2Gen, nout>(buff1, buff2, nchns, pps, tol);
+        test_gen_multi<RotatorGen, nout>(buff1, buff2, nchns, pps, tol);
+        test_gen_multi<AVX512Gen, nout>(buff1, buff2, nchns, pps, tol);
+#elif NACS_CPU_AARCH64
+        test_gen_multi<NEONGen, nout>(buff1, buff2, nchns, pps, tol);
+#  ifdef NACS_SPCM_SVE
+        test_gen_multi<SVEGen, nout>(buff1, buff2, nchns, pps, tol);
+#  endif
+#endif
+    }
+}
+
+// A single output channel with a tone count known at compile time.
+template<int ntones>
+static void test_steps_ntones(float *buff1, int16_t *buff2, int rep)
+{
+    constexpr size_t nsteps = 2048 / step_size;
+    std::uniform_real_distribution<float> f_dis(-2, 2);
+    std::uniform_real_distribution<float> a_dis(0, 2);
+    std::uniform_int_distribution<uint32_t> ph_dis;
+    std::vector<channel_param_fixed> ps(ntones);
+    std::vector<uint32_t> ph(ntones);
+    std::vector<uint32_t> dph(ntones);
+    int nchns[1] = {ntones};
+    for (int j = 0; j < rep; j++) {
+        for (int k = 0; k < ntones; k++) {
+            auto freq = f_dis(gen);
+            ps[k] = {0, freq, a_dis(gen) * i16_scale};
+            ph[k] = ph_dis(gen);
+            dph[k] = uint32_t(int64_t(double(freq) * 0x1p32));
+        }
+        test_gen_steps<ScalarGen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_gen_steps<SSE2Gen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+        test_gen_steps<AVXGen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+        test_gen_steps<AVX2Gen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+        test_gen_steps<RotatorGen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+        test_gen_steps<AVX512Gen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+#elif NACS_CPU_AARCH64
+        test_gen_steps<NEONGen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+#  ifdef NACS_SPCM_SVE
+        test_gen_steps<SVEGen, 1, ntones>(buff1, buff2, nsteps, nchns, &ps, &ph, &dph);
+#  endif
+#endif
+    }
+}
+
+// Tones sorted by the ramps they use with the ramps of each group disabled
+// in the generator, compared to the reference with all the ramps.
+template<int nout>
+static void test_groups(float *buff1, int16_t *buff2, int rep)
+{
+    std::uniform_real_distribution<float> pf_dis(-2, 2);
+    std::uniform_real_distribution<float> a_dis(0, 2);
+    std::uniform_int_distribution<int> n_dis(0, 3);
+    std::vector<channel_param_packed> ps[nout];
+    std::vector<channel_param> cps[nout];
+    channel_param_groups groups[nout];
+    const channel_param_groups *pgroups[nout];
+    int nchns[nout];
+    double tol[nout];
+    for (int j = 0; j < rep; j++) {
+        for (int o = 0; o < nout; o++) {
+            // Up to 3 tones in each group, including empty groups.
+            int ngroup[4];
+            nchns[o] = 0;
+            for (auto &n: ngroup) {
+                n = n_dis(gen);
+                nchns[o] += n;
+            }
+            ps[o].resize(nchns[o]);
+            cps[o].resize(nchns[o]);
+            int k = 0;
+            for (int g = 0; g < 4; g++) {
+                for (int i = 0; i < ngroup[g]; i++, k++) {
+                    auto &p = ps[o][k];
+                    p = {pf_dis(gen), pf_dis(gen), g & 1 ? pf_dis(gen) : 0,
+                         a_dis(gen) * i16_scale, g & 2 ? a_dis(gen) * i16_scale : 0};
+                    cps[o][k] = {&p.phase, &p.freq, &p.dfreq, &p.amp, &p.damp};
+                }
+            }
+            groups[o] = {ps[o].data(), ngroup[0], ngroup[0] + ngroup[1],
+                         ngroup[0] + ngroup[1] + ngroup[2]};
+            pgroups[o] = &groups[o];
+            if (nchns[o] == 0) {
+                memset(&buff1[o * step_size], 0, step_size * sizeof(float));
+                tol[o] = 0;
+            }
+            else {
+                tol[o] = calc_wave(&buff1[o * step_size], nchns[o], cps[o].data()) * 0.5e-5;
+            }
+        }
+        test_gen_multi<ScalarGen, nout>(buff1, buff2, nchns, pgroups, tol);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_gen_multi<SSE2Gen, nout>(buff1, buff2, nchns, pgroups, tol);
+        test_gen_multi<AVXGen, nout>(buff1, buff2, nchns, pgroups, tol);
+        test_gen_multi<AVX2Gen, nout>(buff1, buff2, nchns, pgroups, tol);
+        test_gen_multi<RotatorGen, nout>(buff1, buff2, nchns, pgroups, tol);
+        test_gen_multi<AVX512Gen, nout>(buff1, buff2, nchns, pgroups, tol);
+#elif NACS_CPU_AARCH64
+        test_gen_multi<NEONGen, nout>(buff1, buff2, nchns, pgroups, tol);
+#  ifdef NACS_SPCM_SVE
+        test_gen_multi<SVEGen, nout>(buff1, buff2, nchns, pgroups, tol);
+#  endif
+#endif
     }
 }
 
 int main()
 {
     static_assert(4096 > step_size * sizeof(float), "");
+    static_assert(4096 >= FFTSynth::block_size * sizeof(float), "");
     auto buff1 = (float*)mapAnonPage(4096, Prot::RW);
     auto buff2 = (float*)mapAnonPage(4096, Prot::RW);
     auto t0 = getTime();
@@ -199,7 +853,47 @@ int main()
         test_nchn(buff1, buff2, 2, 500);
         test_nchn(buff1, buff2, 4, 250);
         test_nchn(buff1, buff2, 10, 100);
+
+        test_step_size<16>(buff1, buff2, 4, 100);
+        test_step_size<64>(buff1, buff2, 4, 100);
+        test_step_size<128>(buff1, buff2, 4, 100);
+
+        test_ramp2(buff1, (int16_t*)buff2, 1, 1000);
+        test_ramp2(buff1, (int16_t*)buff2, 10, 100);
+
+        test_precision(buff1, buff2, 1, 1000);
+        test_precision(buff1, buff2, 10, 100);
+
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+        test_q15<32>(buff1, (int16_t*)buff2, 1, 1000);
+        test_q15<32>(buff1, (int16_t*)buff2, 10, 100);
+        test_q15<64>(buff1, (int16_t*)buff2, 10, 100);
+        test_q15<128>(buff1, (int16_t*)buff2, 10, 100);
+#endif
+
+        test_fft_synth(buff1, buff2, 1, 10);
+        test_fft_synth(buff1, buff2, 200, 2);
+
+        test_multi<1>(buff1, (int16_t*)buff2, 250);
+        test_multi<2>(buff1, (int16_t*)buff2, 250);
+        test_multi<4>(buff1, (int16_t*)buff2, 250);
+
+        test_groups<1>(buff1, (int16_t*)buff2, 250);
+        test_groups<2>(buff1, (int16_t*)buff2, 250);
+        test_groups<4>(buff1, (int16_t*)buff2, 250);
+
+        test_steps<1>(buff1, (int16_t*)buff2, 50);
+        test_steps<2>(buff1, (int16_t*)buff2, 50);
+        test_steps<4>(buff1, (int16_t*)buff2, 50);
+
+        test_steps_ntones<1>(buff1, (int16_t*)buff2, 20);
+        test_steps_ntones<3>(buff1, (int16_t*)buff2, 20);
+        test_steps_ntones<16>(buff1, (int16_t*)buff2, 20);
     } while (getElapse(t0) < 10ull * 1000 * 1000 * 1000);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+    report_q15<AVX2Q15Gen>(avx2_q15_err);
+    report_q15<AVX512Q15Gen>(avx512_q15_err);
+#endif
     unmapPage(buff1, 4096);
     unmapPage(buff2, 4096);
     return 0;
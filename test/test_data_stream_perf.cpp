@@ -16,9 +16,9 @@
  *   see <http://www.gnu.org/licenses/>.                                 *
  *************************************************************************/
 
-#include "calc_wave_helper.h"
+#include "../nacs-spcm/data_stream_p.h"
+#include "../nacs-spcm/fft_synth_p.h"
 
-#include <nacs-utils/processor.h>
 #include <nacs-utils/timer.h>
 #include <nacs-utils/mem.h>
 
@@ -43,7 +43,8 @@ static void fill_random(std::vector<float> &data, float lb, float ub)
 template<typename Gen>
 NACS_NOINLINE void benchmark_chn_sz(float *data, size_t sz, size_t rep, int nchn,
                                     channel_param_fixed *params_fixed,
-                                    channel_param *params)
+                                    channel_param *params,
+                                    channel_param_packed *params_packed)
 {
     Timer timer;
     Runner<Gen>::run_wave_fixed(data, sz, 1, nchn, params_fixed);
@@ -56,9 +57,32 @@ NACS_NOINLINE void benchmark_chn_sz(float *data, size_t sz, size_t rep, int nchn
     Runner<Gen>::run_wave(data, sz, rep, nchn, params);
     auto change = timer.elapsed();
 
+    timer.restart();
+    Runner<Gen>::run_wave_packed(data, sz, rep, nchn, params_packed);
+    auto packed = timer.elapsed();
+
+    // Output directly in the format of the card.
+    auto data_i16 = (int16_t*)data;
+    timer.restart();
+    Runner<Gen>::run_wave_fixed(data_i16, sz, rep, nchn, params_fixed);
+    auto fixed_i16 = timer.elapsed();
+
+    timer.restart();
+    Runner<Gen>::run_wave(data_i16, sz, rep, nchn, params);
+    auto change_i16 = timer.elapsed();
+
+    timer.restart();
+    Runner<Gen>::run_wave_packed(data_i16, sz, rep, nchn, params_packed);
+    auto packed_i16 = timer.elapsed();
+
+    auto scale = 1 / double(sz) / (double)rep / nchn;
     std::cout << "  [nchn: " << nchn << ", rep: " << rep << "] "
-              << "Fixed: " << double(fixed) / double(sz) / (double)rep / nchn << " ns; Change: "
-              << double(change) / double(sz) / (double)rep / nchn << " ns" << std::endl;
+              << "Fixed: " << double(fixed) * scale << " ns; Change: "
+              << double(change) * scale << " ns; Packed: "
+              << double(packed) * scale << " ns; Fixed (i16): "
+              << double(fixed_i16) * scale << " ns; Change (i16): "
+              << double(change_i16) * scale << " ns; Packed (i16): "
+              << double(packed_i16) * scale << " ns" << std::endl;
 }
 
 template<typename Gen>
@@ -95,42 +119,374 @@ NACS_NOINLINE void benchmark_chn(float *data, size_t sz, size_t rep, int nchn)
         ps[i] = {vps[i].phase.data(), vps[i].freq.data(), vps[i].dfreq.data(),
                  vps[i].amp.data(), vps[i].damp.data()};
     }
-    benchmark_chn_sz<Gen>(data, sz, rep, nchn, ps_fixed.data(), ps.data());
+    size_t nsteps = sz / step_size;
+    std::vector<channel_param_packed> ps_packed(nsteps * nchn);
+    for (size_t s = 0; s < nsteps; s++) {
+        for (int i = 0; i < nchn; i++) {
+            ps_packed[s * nchn + i] = {vps[i].phase[s], vps[i].freq[s], vps[i].dfreq[s],
+                                       vps[i].amp[s], vps[i].damp[s]};
+        }
+    }
+    benchmark_chn_sz<Gen>(data, sz, rep, nchn, ps_fixed.data(), ps.data(),
+                          ps_packed.data());
+}
+
+// Same tones on each of the `nout` channels, interleaved into a single `int16_t` buffer.
+template<typename Gen, int nout>
+NACS_NOINLINE void benchmark_multi(int16_t *data, size_t sz, size_t rep, int nchn)
+{
+    std::vector<float> phase(nchn);
+    std::vector<float> freq(nchn);
+    std::vector<float> amp(nchn);
+    fill_random(phase, -2, 2);
+    fill_random(freq, -2, 2);
+    fill_random(amp, 0, 2);
+    std::vector<channel_param_fixed> ps(nchn);
+    for (int i = 0; i < nchn; i++)
+        ps[i] = {phase[i], freq[i], amp[i]};
+    int nchns[nout];
+    const channel_param_fixed *pps[nout];
+    for (int o = 0; o < nout; o++) {
+        nchns[o] = nchn;
+        pps[o] = ps.data();
+    }
+    sz = sz / nout;
+    Runner<Gen>::template run_wave_multi<nout>(data, sz, 1, nchns, pps);
+    Timer timer;
+    Runner<Gen>::template run_wave_multi<nout>(data, sz, rep, nchns, pps);
+    auto t = timer.elapsed();
+    std::cout << "  [nout: " << nout << ", nchn: " << nchn << ", rep: " << rep << "] "
+              << "Fixed (i16): " << double(t) / double(sz) / (double)rep / nchn / nout
+              << " ns" << std::endl;
+}
+
+// Random constant tones for the batched kernels (`run_wave_steps`) with the 32bit phase
+// and its change per step for each tone. The phases in `ps` are filled in by the kernels.
+static void fill_step_tones(int nchn, std::vector<channel_param_fixed> &ps,
+                            std::vector<uint32_t> &phase, std::vector<uint32_t> &dphase)
+{
+    std::vector<float> freq(nchn);
+    std::vector<float> amp(nchn);
+    fill_random(freq, -2, 2);
+    fill_random(amp, 0, 2);
+    ps.resize(nchn);
+    phase.resize(nchn);
+    dphase.resize(nchn);
+    for (int i = 0; i < nchn; i++) {
+        ps[i] = {0, freq[i], amp[i]};
+        phase[i] = uint32_t(gen());
+        // The frequency is in cycles per step.
+        dphase[i] = uint32_t(int64_t(double(freq[i]) * 0x1p32));
+    }
+}
+
+// Constant tones generated one step per call with the phases updated between the calls
+// (`run_wave_multi`) compared to all the steps in a single call (`run_wave_steps`).
+template<typename Gen>
+NACS_NOINLINE void benchmark_batch(int16_t *data, size_t sz, size_t rep, int nchn)
+{
+    std::vector<channel_param_fixed> ps;
+    std::vector<uint32_t> phase;
+    std::vector<uint32_t> dphase;
+    fill_step_tones(nchn, ps, phase, dphase);
+    size_t nsteps = sz / step_size;
+    auto pps = ps.data();
+    const channel_param_fixed *cpps = ps.data();
+    auto pphase = phase.data();
+    auto pdphase = dphase.data();
+    Timer timer;
+    for (size_t r = 0; r < rep; r++) {
+        for (size_t s = 0; s < nsteps; s++) {
+            for (int i = 0; i < nchn; i++)
+                ps[i].phase = float(int32_t(phase[i] + uint32_t(s) * dphase[i])) * 0x1p-31f;
+            Runner<Gen>::template run_wave_multi<1>(&data[s * step_size], step_size, 1,
+                                                    &nchn, &cpps);
+        }
+    }
+    auto per_step = timer.elapsed();
+    timer.restart();
+    for (size_t r = 0; r < rep; r++)
+        Runner<Gen>::template run_wave_steps<1>(data, nsteps, &nchn, &pps,
+                                                &pphase, &pdphase);
+    auto batch = timer.elapsed();
+    auto scale = 1 / double(sz) / (double)rep / nchn;
+    std::cout << "  [nchn: " << nchn << ", rep: " << rep << "] "
+              << "Per step: " << double(per_step) * scale << " ns; Batch: "
+              << double(batch) * scale << " ns" << std::endl;
+}
+
+// Batches of constant tones on a single channel (`run_wave_steps`) with the generic loop
+// over the tones compared to the kernel unrolled for `N` tones (`run_wave_steps_ntones`).
+template<typename Gen, int N>
+NACS_NOINLINE void benchmark_ntones(int16_t *data, size_t sz, size_t rep)
+{
+    int nchn = N;
+    std::vector<channel_param_fixed> ps;
+    std::vector<uint32_t> phase;
+    std::vector<uint32_t> dphase;
+    fill_step_tones(nchn, ps, phase, dphase);
+    size_t nsteps = sz / step_size;
+    auto pps = ps.data();
+    auto pphase = phase.data();
+    auto pdphase = dphase.data();
+    Timer timer;
+    for (size_t r = 0; r < rep; r++)
+        Runner<Gen>::template run_wave_steps<1>(data, nsteps, &nchn, &pps,
+                                                &pphase, &pdphase);
+    auto generic = timer.elapsed();
+    timer.restart();
+    for (size_t r = 0; r < rep; r++)
+        Runner<Gen>::template run_wave_steps_ntones<N>(data, nsteps, &nchn, &pps,
+                                                       &pphase, &pdphase);
+    auto unrolled = timer.elapsed();
+    auto scale = 1 / double(sz) / (double)rep / nchn;
+    std::cout << "  [nchn: " << nchn << ", rep: " << rep << "] "
+              << "Loop: " << double(generic) * scale << " ns; Unrolled: "
+              << double(unrolled) * scale << " ns" << std::endl;
+}
+
+// Mostly static tones with a few ramping ones, generated with the ramps computed
+// for all the tones (packed parameters) compared to only for the ramping ones (groups).
+template<typename Gen>
+NACS_NOINLINE void benchmark_groups(int16_t *data, size_t sz, size_t rep,
+                                    int nchn, int nramp)
+{
+    std::vector<float> phase(nchn);
+    std::vector<float> freq(nchn);
+    std::vector<float> amp(nchn);
+    fill_random(phase, -2, 2);
+    fill_random(freq, -2, 2);
+    fill_random(amp, 0, 2);
+    // The ramping tones are at the end.
+    std::vector<channel_param_packed> ps(nchn);
+    for (int i = 0; i < nchn; i++) {
+        bool ramp = i >= nchn - nramp;
+        ps[i] = {phase[i], freq[i], ramp ? 0.01f : 0, amp[i], ramp ? 0.01f : 0};
+    }
+    const channel_param_packed *pps = ps.data();
+    channel_param_groups groups{ps.data(), nchn - nramp, nchn - nramp, nchn - nramp};
+    const channel_param_groups *pgroups = &groups;
+    size_t nsteps = sz / step_size;
+    Timer timer;
+    for (size_t r = 0; r < rep; r++) {
+        for (size_t s = 0; s < nsteps; s++) {
+            Runner<Gen>::template run_wave_multi<1, step_size, channel_param_packed>(
+                &data[s * step_size], step_size, 1, &nchn, &pps);
+        }
+    }
+    auto packed = timer.elapsed();
+    timer.restart();
+    for (size_t r = 0; r < rep; r++) {
+        for (size_t s = 0; s < nsteps; s++) {
+            Runner<Gen>::template run_wave_multi<1, step_size, channel_param_groups>(
+                &data[s * step_size], step_size, 1, &nchn, &pgroups);
+        }
+    }
+    auto grouped = timer.elapsed();
+    auto scale = 1 / double(sz) / (double)rep / nchn;
+    std::cout << "  [nchn: " << nchn << ", nramp: " << nramp << ", rep: " << rep << "] "
+              << "Packed: " << double(packed) * scale << " ns; Groups: "
+              << double(grouped) * scale << " ns" << std::endl;
+}
+
+// Ramps with the parameters updated every `S` samples.
+template<typename Gen, int S>
+NACS_NOINLINE void benchmark_step(float *data, size_t sz, size_t rep, int nchn)
+{
+    size_t nsteps = sz / S;
+    std::vector<float> vals(nsteps * nchn * 5);
+    fill_random(vals, 0, 2);
+    std::vector<channel_param_packed> ps(nsteps * nchn);
+    for (size_t i = 0; i < nsteps * nchn; i++)
+        ps[i] = {vals[i * 5], vals[i * 5 + 1], vals[i * 5 + 2],
+                 vals[i * 5 + 3], vals[i * 5 + 4]};
+    Runner<Gen>::template run_wave_packed<S>(data, sz, 1, nchn, ps.data());
+    Timer timer;
+    Runner<Gen>::template run_wave_packed<S>(data, sz, rep, nchn, ps.data());
+    auto t = timer.elapsed();
+    std::cout << "  [step: " << S << ", nchn: " << nchn << ", rep: " << rep << "] "
+              << "Packed: " << double(t) / double(sz) / (double)rep / nchn
+              << " ns" << std::endl;
+}
+
+// The cost of the second order ramps compared to the linear ones,
+// with the parameters updated every step.
+template<typename Gen>
+NACS_NOINLINE void benchmark_ramp2(int16_t *data, size_t sz, size_t rep, int nchn)
+{
+    size_t nsteps = sz / step_size;
+    std::vector<float> vals(nsteps * nchn * 7);
+    fill_random(vals, 0, 2);
+    std::vector<channel_param_packed> ps(nsteps * nchn);
+    std::vector<channel_param_ramp2> ps2(nsteps * nchn);
+    for (size_t i = 0; i < nsteps * nchn; i++) {
+        auto v = &vals[i * 7];
+        ps[i] = {v[0], v[1], v[2], v[4], v[5]};
+        ps2[i] = {v[0], v[1], v[2], v[3], v[4], v[5], v[6]};
+    }
+    const channel_param_packed *pps = ps.data();
+    const channel_param_ramp2 *pps2 = ps2.data();
+    Runner<Gen>::template run_wave_multi<1>(data, sz, 1, &nchn, &pps);
+    Timer timer;
+    Runner<Gen>::template run_wave_multi<1>(data, sz, rep, &nchn, &pps);
+    auto t = timer.elapsed();
+    Runner<Gen>::template run_wave_multi<1>(data, sz, 1, &nchn, &pps2);
+    timer.restart();
+    Runner<Gen>::template run_wave_multi<1>(data, sz, rep, &nchn, &pps2);
+    auto t2 = timer.elapsed();
+    auto scale = 1 / double(sz) / (double)rep / nchn;
+    std::cout << "  [nchn: " << nchn << ", rep: " << rep << "] "
+              << "Packed (i16): " << double(t) * scale << " ns; Ramp2 (i16): "
+              << double(t2) * scale << " ns" << std::endl;
+}
+
+// Compare the direct generation of constant tones with `FFTSynth`
+// to find the number of tones above which the FFT is faster.
+template<typename Gen>
+NACS_NOINLINE void benchmark_fft(float *data, size_t sz, size_t rep)
+{
+    std::uniform_real_distribution<double> phase_dis(0, 1);
+    std::uniform_real_distribution<double> freq_dis(-0.5, 0.5);
+    std::uniform_real_distribution<double> amp_dis(0, 1);
+    FFTSynth synth;
+    int crossover = 0;
+    for (int nchn = 8; nchn <= 512; nchn *= 2) {
+        std::vector<FFTSynth::Tone> tones(nchn);
+        std::vector<channel_param_fixed> ps(nchn);
+        for (int i = 0; i < nchn; i++) {
+            tones[i] = {phase_dis(gen), freq_dis(gen), amp_dis(gen)};
+            ps[i] = {float(tones[i].phase * 2), float(tones[i].freq * step_size * 2),
+                     float(tones[i].amp)};
+        }
+        auto nrep = std::max<size_t>(rep / nchn, 1);
+        Runner<Gen>::run_wave_fixed(data, sz, 1, nchn, ps.data());
+        Timer timer;
+        Runner<Gen>::run_wave_fixed(data, sz, nrep, nchn, ps.data());
+        auto direct = timer.elapsed();
+
+        synth.run(data, tones.data(), nchn);
+        timer.restart();
+        for (size_t r = 0; r < nrep; r++) {
+            for (size_t i = 0; i < sz; i += FFTSynth::block_size) {
+                synth.run(&data[i], tones.data(), nchn);
+            }
+        }
+        auto fft = timer.elapsed();
+        if (!crossover && fft < direct)
+            crossover = nchn;
+
+        auto scale = 1 / double(sz) / (double)nrep / nchn;
+        std::cout << "  [nchn: " << nchn << ", rep: " << nrep << "] "
+                  << "Direct: " << double(direct) * scale << " ns; FFT: "
+                  << double(fft) * scale << " ns" << std::endl;
+    }
+    std::cout << "  FFT crossover: " << crossover << " (using "
+              << Gen::fft_min_tones << ")" << std::endl;
 }
 
 template<typename Gen>
 void benchmark(size_t sz, size_t rep)
 {
+    if (!Gen::supported())
+        return;
+    std::cout << Gen::name() << ":" << std::endl;
     auto data = (float*)mapAnonPage(sz * sizeof(float), Prot::RW);
     benchmark_chn<Gen>(data, sz, rep, 1);
     benchmark_chn<Gen>(data, sz, rep / 2, 2);
     benchmark_chn<Gen>(data, sz, rep / 4, 4);
     benchmark_chn<Gen>(data, sz, rep / 10, 10);
+    benchmark_chn<Gen>(data, sz, rep / 20, 20);
+    benchmark_chn<Gen>(data, sz, rep / 64, 64);
+    benchmark_chn<Gen>(data, sz, rep / 256, 256);
+    benchmark_multi<Gen, 2>((int16_t*)data, sz, rep / 10, 10);
+    benchmark_multi<Gen, 4>((int16_t*)data, sz, rep / 10, 10);
+    benchmark_step<Gen, 16>(data, sz, rep / 10, 10);
+    benchmark_step<Gen, 64>(data, sz, rep / 10, 10);
+    benchmark_step<Gen, 128>(data, sz, rep / 10, 10);
+    benchmark_ramp2<Gen>((int16_t*)data, sz, rep / 10, 10);
+    benchmark_batch<Gen>((int16_t*)data, sz, rep, 1);
+    benchmark_batch<Gen>((int16_t*)data, sz, rep / 4, 4);
+    benchmark_batch<Gen>((int16_t*)data, sz, rep / 20, 20);
+    benchmark_ntones<Gen, 1>((int16_t*)data, sz, rep);
+    benchmark_ntones<Gen, 2>((int16_t*)data, sz, rep / 2);
+    benchmark_ntones<Gen, 4>((int16_t*)data, sz, rep / 4);
+    benchmark_ntones<Gen, 8>((int16_t*)data, sz, rep / 8);
+    benchmark_ntones<Gen, 16>((int16_t*)data, sz, rep / 16);
+    benchmark_groups<Gen>((int16_t*)data, sz, rep / 64, 64, 4);
+    benchmark_fft<Gen>(data, sz, rep);
     unmapPage(data, sz * sizeof(float));
 }
 
+// The other precision tiers, to be compared with the default one above.
+template<template<Precision> class Gen>
+void benchmark_prec(size_t sz, size_t rep)
+{
+    using DefGen = Gen<Precision::Default>;
+    if (!DefGen::supported())
+        return;
+    auto data = (float*)mapAnonPage(sz * sizeof(float), Prot::RW);
+    std::cout << DefGen::name() << " (low precision):" << std::endl;
+    benchmark_chn<Gen<Precision::Low>>(data, sz, rep, 1);
+    benchmark_chn<Gen<Precision::Low>>(data, sz, rep / 10, 10);
+    benchmark_chn<Gen<Precision::Low>>(data, sz, rep / 64, 64);
+    std::cout << DefGen::name() << " (high precision):" << std::endl;
+    benchmark_chn<Gen<Precision::High>>(data, sz, rep / 10, 1);
+    benchmark_chn<Gen<Precision::High>>(data, sz, rep / 100, 10);
+    benchmark_chn<Gen<Precision::High>>(data, sz, rep / 640, 64);
+    unmapPage(data, sz * sizeof(float));
+}
+
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+// The integer generators, to be compared with the floating point ones above.
+template<typename Gen>
+void benchmark_q15(size_t sz, size_t rep)
+{
+    if (!Gen::supported())
+        return;
+    std::cout << Gen::name() << ":" << std::endl;
+    auto data = (float*)mapAnonPage(sz * sizeof(float), Prot::RW);
+    benchmark_chn<Gen>(data, sz, rep, 1);
+    benchmark_chn<Gen>(data, sz, rep / 4, 4);
+    benchmark_chn<Gen>(data, sz, rep / 10, 10);
+    benchmark_chn<Gen>(data, sz, rep / 64, 64);
+    benchmark_chn<Gen>(data, sz, rep / 256, 256);
+    benchmark_multi<Gen, 2>((int16_t*)data, sz, rep / 10, 10);
+    benchmark_multi<Gen, 4>((int16_t*)data, sz, rep / 10, 10);
+    benchmark_step<Gen, 64>(data, sz, rep / 10, 10);
+    benchmark_step<Gen, 128>(data, sz, rep / 10, 10);
+    unmapPage(data, sz * sizeof(float));
+}
+#endif
+
 int main()
 {
-    std::cout << "Scalar:" << std::endl;
     benchmark<ScalarGen>(2 * 4096, 4096 * 2);
-
-    auto &host NACS_UNUSED = CPUInfo::get_host();
 #if NACS_CPU_X86 || NACS_CPU_X86_64
-    std::cout << "SSE2:" << std::endl;
     benchmark<SSE2Gen>(2 * 4096, 4096 * 4);
-    if (host.test_feature(X86::Feature::avx)) {
-        std::cout << "AVX:" << std::endl;
-        benchmark<AVXGen>(2 * 4096, 4096 * 4);
-    }
-    if (host.test_feature(X86::Feature::avx2) && host.test_feature(X86::Feature::fma)) {
-        std::cout << "AVX2:" << std::endl;
-        benchmark<AVX2Gen>(2 * 4096, 4096 * 8);
-    }
-    if (host.test_feature(X86::Feature::avx512f) &&
-        host.test_feature(X86::Feature::avx512dq)) {
-        std::cout << "AVX512:" << std::endl;
-        benchmark<AVX512Gen>(2 * 4096, 4096 * 16);
-    }
+    benchmark<AVXGen>(2 * 4096, 4096 * 4);
+    benchmark<AVX2Gen>(2 * 4096, 4096 * 8);
+    benchmark<RotatorGen>(2 * 4096, 4096 * 8);
+    benchmark<AVX512Gen>(2 * 4096, 4096 * 16);
+    benchmark_q15<AVX2Q15Gen>(2 * 4096, 4096 * 8);
+    benchmark_q15<AVX512Q15Gen>(2 * 4096, 4096 * 16);
+#elif NACS_CPU_AARCH64
+    benchmark<NEONGen>(2 * 4096, 4096 * 4);
+#  ifdef NACS_SPCM_SVE
+    benchmark<SVEGen>(2 * 4096, 4096 * 8);
+#  endif
+#endif
+
+    benchmark_prec<ScalarGenT>(2 * 4096, 4096 * 2);
+#if NACS_CPU_X86 || NACS_CPU_X86_64
+    benchmark_prec<SSE2GenT>(2 * 4096, 4096 * 4);
+    benchmark_prec<AVXGenT>(2 * 4096, 4096 * 4);
+    benchmark_prec<AVX2GenT>(2 * 4096, 4096 * 8);
+    benchmark_prec<AVX512GenT>(2 * 4096, 4096 * 16);
+#elif NACS_CPU_AARCH64
+    benchmark_prec<NEONGenT>(2 * 4096, 4096 * 4);
+#  ifdef NACS_SPCM_SVE
+    benchmark_prec<SVEGenT>(2 * 4096, 4096 * 8);
+#  endif
 #endif
 
     return 0;
@@ -0,0 +1,101 @@
+/*************************************************************************
+ *   Copyright (c) 2019 - 2019 Yichao Yu <yyc1992@gmail.com>             *
+ *                                                                       *
+ *   This library is free software; you can redistribute it and/or       *
+ *   modify it under the terms of the GNU Lesser General Public          *
+ *   License as published by the Free Software Foundation; either        *
+ *   version 3.0 of the License, or (at your option) any later version.  *
+ *                                                                       *
+ *   This library is distributed in the hope that it will be useful,     *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of      *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU    *
+ *   Lesser General Public License for more details.                     *
+ *                                                                       *
+ *   You should have received a copy of the GNU Lesser General Public    *
+ *   License along with this library. If not,                            *
+ *   see <http://www.gnu.org/licenses/>.                                 *
+ *************************************************************************/
+
+#include <nacs-spcm/data_stream.h>
+#include <nacs-spcm/dma_buffer.h>
+#include <nacs-spcm/spcm_sim.h>
+#include <nacs-utils/timer.h>
+
+#include <stdlib.h>
+
+#include <iostream>
+#include <vector>
+
+using namespace NaCs;
+
+// Stream to the simulated card in real time.
+// Usage: test-stream_sim [ntones] [sample rate] [duration in seconds] [nworkers]
+int main(int argc, char **argv)
+{
+    uint32_t ntones = argc > 1 ? uint32_t(atoi(argv[1])) : 8;
+    int64_t rate = argc > 2 ? int64_t(atof(argv[2])) : 50000000;
+    double duration = argc > 3 ? atof(argv[3]) : 1;
+    int nworkers = argc > 4 ? atoi(argv[4]) : 0;
+
+    Spcm::Spcm card("sim");
+    card.ch_enable(CHANNEL0);
+    card.set_param(SPC_CARDMODE, SPC_REP_FIFO_SINGLE);
+    card.set_param(SPC_SAMPLERATE, rate);
+    card.set_param(SPC_TIMEOUT, 1000);
+    // Much smaller than the real on board memory so that all the buffered data
+    // is output many times within the test and the generator has to keep up.
+    constexpr int64_t mem_size = 16 * 1024 * 1024;
+    card.set_param(SPC_PCIMEMSIZE, mem_size);
+    card.write_setup();
+
+    Spcm::DataStream stream(ntones);
+    stream.set_workers(std::vector<int>(nworkers, -1));
+    for (uint32_t i = 0; i < ntones; i++) {
+        stream.add_cmd({0, i, Spcm::DataStream::CmdType::Freq, 0.01 + 0.3 * i / ntones});
+        stream.add_cmd({0, i, Spcm::DataStream::CmdType::Amp, 0.9 / ntones});
+    }
+
+    constexpr uint32_t notify_size = 1024 * 1024;
+    constexpr uint32_t buff_size = 8 * notify_size;
+    Spcm::DMABuffer buff(card, buff_size, notify_size);
+    while (stream.generate(buff)) {
+    }
+    card.cmd(M2CMD_DATA_STARTDMA | M2CMD_DATA_WAITDMA);
+    card.check_error();
+    card.cmd(M2CMD_CARD_START | M2CMD_CARD_ENABLETRIGGER);
+    card.check_error();
+
+    Timer timer;
+    uint64_t t0 = stream.cur_t();
+    try {
+        while (timer.elapsed() < uint64_t(duration * 1e9)) {
+            buff.wait_span(notify_size);
+            stream.generate(buff);
+        }
+    }
+    catch (const Spcm::Error &err) {
+        std::cerr << err.what() << std::endl;
+    }
+    auto elapsed = double(timer.elapsed()) * 1e-9;
+    auto stats = Spcm::Sim::get_stats(card);
+    card.cmd(M2CMD_CARD_STOP | M2CMD_DATA_STOPDMA);
+
+    std::cout << "Generator: " << Spcm::DataStream::gen_name() << std::endl;
+    std::cout << "Generated: " << double(stream.cur_t() - t0) / elapsed / 1e6
+              << " MS/s" << std::endl;
+    std::cout << "Output: " << double(stats.consumed) / 2 / 1e6 << " MS" << std::endl;
+    std::cout << "Underruns: " << stats.underruns << std::endl;
+    // Otherwise the output can't underrun even if the generator is too slow.
+    if (!stats.underruns && stats.consumed < uint64_t(mem_size) + buff_size) {
+        std::cerr << "Not enough output to drain the buffers" << std::endl;
+        return 1;
+    }
+    std::cout << "Minimum lead: " << stats.min_lead * 1e3 << " ms" << std::endl;
+    auto worker_stats = stream.worker_stats();
+    for (size_t i = 0; i < worker_stats.size(); i++) {
+        auto &ws = worker_stats[i];
+        std::cout << "Worker " << i << ": "
+                  << double(ws.nsteps * 32) / double(ws.time) * 1e3 << " MS/s" << std::endl;
+    }
+    return stats.underruns ? 1 : 0;
+}